@@ -1,20 +1,126 @@
 #!/bin/bash
-clang++ -std=c++17 \
-  src/main.cpp \
-  src/authentication/auth.cpp \
+# Usage: ./build.sh [app|bench|loadtest|test|all]   (default: app)
+#
+# Uses Homebrew prefixes when brew is available. Elsewhere (plain Linux)
+# the system compiler and libraries are used: install libsodium-dev,
+# libsqlite3-dev and zlib1g-dev, and put Crow's and asio's headers on the
+# include path (/usr/local/include by default, or set CROW_INCLUDE / ASIO_INCLUDE).
+# Override the compiler with CXX=g++ and add flags with CXXFLAGS.
+set -e
+target=${1:-app}
+
+CXX=${CXX:-$(command -v clang++ || command -v g++)}
+CXXFLAGS=${CXXFLAGS:-}
+
+if command -v brew >/dev/null 2>&1; then
+  DEP_FLAGS="-I$(brew --prefix crow)/include \
+    -I$(brew --prefix asio)/include \
+    -I$(brew --prefix libsodium)/include \
+    -I$(brew --prefix sqlite)/include \
+    -L$(brew --prefix libsodium)/lib \
+    -L$(brew --prefix sqlite)/lib"
+else
+  DEP_FLAGS="${CROW_INCLUDE:+-I$CROW_INCLUDE} ${ASIO_INCLUDE:+-I$ASIO_INCLUDE} -pthread"
+  if command -v pkg-config >/dev/null 2>&1; then
+    DEP_FLAGS="$DEP_FLAGS $(pkg-config --cflags --libs-only-L libsodium sqlite3 2>/dev/null || true)"
+  fi
+fi
+LIBS="-lsodium -lsqlite3 -lz"
+
+INCLUDES="-Isrc/authentication \
+  -Isrc/number_reverser \
+  -Isrc/text_analyzer \
+  -Isrc/metrics \
+  -Isrc/compression \
+  -Isrc/tracing \
+  -Isrc/executor \
+  -Isrc/matchmaking \
+  -Isrc/timing_wheel \
+  -Isrc/game_clock \
+  -Isrc/spectator \
+  -Isrc/leaderboard \
+  -Isrc/archive \
+  -Isrc/maintenance \
+  -Isrc/position_index \
+  -Isrc/prefork \
+  -Isrc/othello"
+
+# Everything except main.cpp, shared by the app and the benchmarks
+CORE_SRCS="src/authentication/auth.cpp \
   src/number_reverser/number_reverser.cpp \
+  src/text_analyzer/text_analyzer.cpp \
+  src/metrics/metrics.cpp \
+  src/metrics/metrics_middleware.cpp \
+  src/compression/compression.cpp \
+  src/compression/compression_middleware.cpp \
+  src/tracing/tracing.cpp \
+  src/tracing/trace_middleware.cpp \
+  src/executor/executor.cpp \
+  src/matchmaking/matchmaking.cpp \
+  src/timing_wheel/timing_wheel.cpp \
+  src/game_clock/game_clock.cpp \
+  src/spectator/spectator_hub.cpp \
+  src/leaderboard/leaderboard.cpp \
+  src/archive/game_archive.cpp \
+  src/maintenance/db_maintenance.cpp \
+  src/position_index/position_index.cpp \
   src/othello/othello.cpp \
   src/othello/board/board.cpp \
+  src/othello/board/board_json.cpp \
+  src/othello/analysis/position_analysis.cpp \
   src/othello/players/player.cpp \
-  src/othello/pieces/pieces.cpp \
-  -Isrc/authentication \
-  -Isrc/number_reverser \
-  -Isrc/othello \
-  -I$(brew --prefix crow)/include \
-  -I$(brew --prefix asio)/include \
-  -I$(brew --prefix libsodium)/include \
-  -I$(brew --prefix sqlite)/include \
-  -L$(brew --prefix libsodium)/lib \
-  -L$(brew --prefix sqlite)/lib \
-  -lsodium -lsqlite3 \
+  src/othello/pieces/pieces.cpp"
+
+# prefork.cpp replaces libc's bind() for the whole binary (see
+# enable_reuse_port()), so only the app links it.
+build_app() {
+$CXX -std=c++17 $CXXFLAGS \
+  src/main.cpp \
+  src/prefork/prefork.cpp \
+  $CORE_SRCS \
+  $INCLUDES \
+  $DEP_FLAGS \
+  $LIBS -ldl \
   -o app
+}
+
+# Microbenchmarks; prints one JSON object per benchmark.
+build_bench() {
+$CXX -std=c++17 -O2 $CXXFLAGS \
+  src/bench/bench.cpp \
+  $CORE_SRCS \
+  $INCLUDES \
+  $DEP_FLAGS \
+  $LIBS \
+  -o bench
+}
+
+# Simulated players for capacity testing; needs no third-party libraries.
+build_loadtest() {
+$CXX -std=c++17 -O2 -pthread $CXXFLAGS \
+  src/loadtest/loadtest.cpp \
+  src/othello/board/board.cpp \
+  -Isrc/othello \
+  -o loadtest
+}
+
+# Deterministic checks for the timing wheel, matchmaking and the
+# position index; `./build.sh test` builds and runs them.
+build_tests() {
+$CXX -std=c++17 -O2 $CXXFLAGS \
+  src/tests/tests.cpp \
+  $CORE_SRCS \
+  $INCLUDES \
+  $DEP_FLAGS \
+  $LIBS \
+  -o tests
+}
+
+case "$target" in
+  app) build_app ;;
+  bench) build_bench ;;
+  loadtest) build_loadtest ;;
+  test) build_tests; ./tests ;;
+  all) build_app; build_bench; build_loadtest; build_tests ;;
+  *) echo "usage: $0 [app|bench|loadtest|test|all]" >&2; exit 1 ;;
+esac
@@ -0,0 +1,350 @@
+#include "game_archive.h"
+
+#include <crow.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "board/board.h"
+#include "board/board_json.h"
+#include "tracing.h"
+
+using namespace std;
+
+namespace {
+const char kMagic[] = "OTHARC01";
+const size_t kMagicLen = 8;
+const uint8_t kPass = 255;
+
+void putInt(string& out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) out.push_back((char)((v >> (8 * i)) & 0xFF));
+}
+
+void putStr(string& out, const string& s) {
+    size_t n = s.size() < 0xFFFF ? s.size() : 0xFFFF;
+    putInt(out, n, 2);
+    out.append(s, 0, n);
+}
+
+// Bounds-checked reader over one binary record
+struct Reader {
+    const unsigned char* p;
+    const unsigned char* end;
+    bool ok = true;
+
+    uint64_t getInt(int bytes) {
+        if (end - p < bytes) { ok = false; return 0; }
+        uint64_t v = 0;
+        for (int i = 0; i < bytes; i++) v |= (uint64_t)p[i] << (8 * i);
+        p += bytes;
+        return v;
+    }
+    string getStr() {
+        size_t n = (size_t)getInt(2);
+        if (!ok || (size_t)(end - p) < n) { ok = false; return ""; }
+        string s((const char*)p, n);
+        p += n;
+        return s;
+    }
+};
+
+string columnText(sqlite3_stmt* stmt, int col) {
+    const unsigned char* v = sqlite3_column_text(stmt, col);
+    return v ? (const char*)v : "";
+}
+
+struct Row {
+    string player1, player2, status, winner, board_json, moves;
+    int64_t created_at = 0;
+    int64_t updated_at = 0;
+};
+
+bool endedStatus(const string& status) {
+    return status == "finished" || status == "resigned" || status == "timeout" || status == "draw";
+}
+
+// Both formats go through this. Replays `squares` (kPass for a pass) from
+// the start position into row.moves, recomputing the flip masks, and
+// checks that they lead to `board`. A game without moves (older games
+// kept no log) has nothing to check and keeps its board as given.
+bool replayInto(Row& row, const vector<vector<int>>& board, const vector<int>& squares) {
+    int size = (int)board.size();
+    if (!is_board_size(size)) return false;
+    for (const auto& line : board) {
+        if ((int)line.size() != size) return false;
+    }
+    row.board_json = board_to_json(board);
+    row.moves.clear();
+    if (squares.empty()) return true;
+
+    bool valid = false;
+    with_board(initial_board(size), [&](auto& replay) {
+        int side = 1;
+        for (int sq : squares) {
+            if (sq == kPass) {
+                row.moves += move_log_entry(-1, 0);
+            } else {
+                FlipMask flips = sq >= 0 && sq < size * size ? replay.addPiece(sq / size, sq % size, side) : 0;
+                if (!flips) return;
+                row.moves += move_log_entry(sq, flips);
+            }
+            side = -side;
+        }
+        valid = replay.getBoard() == board;
+    });
+    return valid;
+}
+
+bool decodeNdjson(const char* data, size_t len, Row& row) {
+    using crow::json::type;
+    auto j = crow::json::load(data, len);
+    if (!j || j.t() != type::Object) return false;
+    auto has = [&](const char* key, type t) { return j.has(key) && j[key].t() == t; };
+    for (const char* key : {"player1", "player2", "status"}) {
+        if (!has(key, type::String)) return false;
+    }
+    row.player1 = j["player1"].s();
+    row.player2 = j["player2"].s();
+    row.status = j["status"].s();
+    if (has("winner", type::String)) row.winner = j["winner"].s();
+    int64_t now = (int64_t)time(nullptr);
+    row.created_at = has("created_at", type::Number) ? j["created_at"].i() : now;
+    row.updated_at = has("updated_at", type::Number) ? j["updated_at"].i() : row.created_at;
+
+    if (!has("board", type::List)) return false;
+    const auto& b = j["board"];
+    vector<vector<int>> board(b.size());
+    for (size_t r = 0; r < b.size(); r++) {
+        if (b[r].t() != type::List) return false;
+        for (size_t c = 0; c < b[r].size(); c++) {
+            if (b[r][c].t() != type::Number) return false;
+            int v = (int)b[r][c].i();
+            if (v < -1 || v > 1) return false;
+            board[r].push_back(v);
+        }
+    }
+
+    // The stored flip masks aren't trusted; only the squares are replayed
+    vector<LoggedMove> log;
+    if (has("moves", type::String) && !parse_move_log(j["moves"].s(), log)) return false;
+    vector<int> squares;
+    for (const LoggedMove& m : log) squares.push_back(m.square < 0 ? kPass : m.square);
+    return !row.player1.empty() && !row.player2.empty() && replayInto(row, board, squares);
+}
+
+bool decodeBinary(Reader& in, Row& row) {
+    in.getInt(8); // id; imported games get new ids
+    row.created_at = (int64_t)in.getInt(8);
+    row.updated_at = (int64_t)in.getInt(8);
+    row.status = in.getStr();
+    row.player1 = in.getStr();
+    row.player2 = in.getStr();
+    row.winner = in.getStr();
+
+    int size = (int)in.getInt(1);
+    if (!is_board_size(size)) return false;
+    vector<vector<int>> board(size, vector<int>(size, 0));
+    for (int i = 0; i < size * size && in.ok; i += 4) {
+        uint8_t packed = (uint8_t)in.getInt(1);
+        for (int k = 0; k < 4 && i + k < size * size; k++) {
+            int v = (packed >> (2 * k)) & 3;
+            board[(i + k) / size][(i + k) % size] = v == 1 ? 1 : (v == 2 ? -1 : 0);
+        }
+    }
+
+    size_t count = (size_t)in.getInt(2);
+    vector<int> squares;
+    for (size_t i = 0; i < count && in.ok; i++) squares.push_back((int)in.getInt(1));
+    return in.ok && !row.player1.empty() && !row.player2.empty() && replayInto(row, board, squares);
+}
+}
+
+long long GameArchive::exportTo(sqlite3* db, const string& path, Format format) {
+    TraceSpan span("archive.export");
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) return -1;
+    setvbuf(f, nullptr, _IOFBF, 1 << 16);
+
+    sqlite3_stmt* stmt = nullptr;
+    const char* sql =
+        "SELECT id, created_at, updated_at, status, player1, player2, winner, board, moves"
+        " FROM games WHERE status != 'active' ORDER BY id;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        fclose(f);
+        return -1;
+    }
+
+    if (format == Format::Binary) fwrite(kMagic, 1, kMagicLen, f);
+
+    long long count = 0;
+    string rec;
+    vector<LoggedMove> log;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        auto board = board_from_json(columnText(stmt, 7));
+        string moves = columnText(stmt, 8);
+        if (!parse_move_log(moves, log)) log.clear();
+
+        if (format == Format::Ndjson) {
+            crow::json::wvalue out;
+            out["id"] = sqlite3_column_int64(stmt, 0);
+            out["created_at"] = sqlite3_column_int64(stmt, 1);
+            out["updated_at"] = sqlite3_column_int64(stmt, 2);
+            out["status"] = columnText(stmt, 3);
+            out["player1"] = columnText(stmt, 4);
+            out["player2"] = columnText(stmt, 5);
+            out["winner"] = columnText(stmt, 6);
+            out["moves"] = moves;
+            out["board"] = crow::json::wvalue::list();
+            for (size_t r = 0; r < board.size(); r++) {
+                out["board"][r] = crow::json::wvalue::list();
+                for (size_t c = 0; c < board[r].size(); c++) {
+                    out["board"][r][c] = board[r][c];
+                }
+            }
+            string line = out.dump();
+            line += '\n';
+            fwrite(line.data(), 1, line.size(), f);
+        } else {
+            rec.clear();
+            putInt(rec, (uint64_t)sqlite3_column_int64(stmt, 0), 8);
+            putInt(rec, (uint64_t)sqlite3_column_int64(stmt, 1), 8);
+            putInt(rec, (uint64_t)sqlite3_column_int64(stmt, 2), 8);
+            for (int col = 3; col <= 6; col++) putStr(rec, columnText(stmt, col));
+
+            int size = (int)board.size();
+            putInt(rec, (uint64_t)size, 1);
+            for (int i = 0; i < size * size; i += 4) {
+                uint8_t packed = 0;
+                for (int k = 0; k < 4 && i + k < size * size; k++) {
+                    int v = board[(i + k) / size][(i + k) % size];
+                    packed |= (uint8_t)((v == 1 ? 1 : (v == -1 ? 2 : 0)) << (2 * k));
+                }
+                rec.push_back((char)packed);
+            }
+
+            putInt(rec, log.size() < 0xFFFF ? log.size() : 0, 2);
+            if (log.size() < 0xFFFF) {
+                for (const LoggedMove& m : log) rec.push_back((char)(m.square < 0 ? kPass : m.square));
+            }
+
+            string len;
+            putInt(len, rec.size(), 4);
+            fwrite(len.data(), 1, len.size(), f);
+            fwrite(rec.data(), 1, rec.size(), f);
+        }
+        count++;
+    }
+    sqlite3_finalize(stmt);
+
+    bool ok = rc == SQLITE_DONE && !ferror(f);
+    if (fclose(f) != 0) ok = false;
+    return ok ? count : -1;
+}
+
+GameArchive::ImportResult GameArchive::importFrom(sqlite3* db, const string& data, Format format, size_t batch) {
+    TraceSpan span("archive.import");
+    ImportResult result;
+    if (batch == 0) batch = 1;
+
+    sqlite3_stmt* ins = nullptr;
+    const char* sql =
+        "INSERT INTO games(player1, player2, turn, pass_count, board, status, winner, moves, created_at, updated_at, booked)"
+        " VALUES (?, ?, 1, 0, ?, ?, ?, ?, ?, ?, 1);";
+    if (sqlite3_prepare_v2(db, sql, -1, &ins, nullptr) != SQLITE_OK) {
+        result.ok = false;
+        result.error = sqlite3_errmsg(db);
+        return result;
+    }
+
+    size_t pending = 0;
+    bool in_txn = false;
+    auto fail = [&](const string& why) {
+        if (in_txn) sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        in_txn = false;
+        result.ok = false;
+        result.error = why;
+    };
+    auto insert = [&](const Row& row) {
+        if (!endedStatus(row.status)) {
+            result.skipped++;
+            return true;
+        }
+        if (!in_txn) {
+            if (sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+                fail(sqlite3_errmsg(db));
+                return false;
+            }
+            in_txn = true;
+        }
+        sqlite3_reset(ins);
+        sqlite3_bind_text(ins, 1, row.player1.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(ins, 2, row.player2.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(ins, 3, row.board_json.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(ins, 4, row.status.c_str(), -1, SQLITE_TRANSIENT);
+        if (row.winner.empty()) sqlite3_bind_null(ins, 5);
+        else sqlite3_bind_text(ins, 5, row.winner.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(ins, 6, row.moves.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(ins, 7, row.created_at);
+        sqlite3_bind_int64(ins, 8, row.updated_at);
+        if (sqlite3_step(ins) != SQLITE_DONE) {
+            fail(sqlite3_errmsg(db));
+            return false;
+        }
+        if (++pending == batch) {
+            if (sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+                fail(sqlite3_errmsg(db));
+                return false;
+            }
+            in_txn = false;
+            result.imported += (long long)pending;
+            pending = 0;
+        }
+        return true;
+    };
+
+    Row row;
+    if (format == Format::Ndjson) {
+        size_t pos = 0;
+        while (pos < data.size() && result.ok) {
+            size_t end = data.find('\n', pos);
+            if (end == string::npos) end = data.size();
+            size_t len = end - pos;
+            if (len && data[end - 1] == '\r') len--;
+            if (len) {
+                row = Row();
+                if (decodeNdjson(data.data() + pos, len, row)) insert(row);
+                else result.skipped++;
+            }
+            pos = end + 1;
+        }
+    } else {
+        if (data.size() < kMagicLen || memcmp(data.data(), kMagic, kMagicLen) != 0) {
+            fail("Not a game archive");
+        }
+        const unsigned char* p = (const unsigned char*)data.data() + kMagicLen;
+        const unsigned char* end = (const unsigned char*)data.data() + data.size();
+        while (p < end && result.ok) {
+            Reader len{p, end};
+            size_t n = (size_t)len.getInt(4);
+            if (!len.ok || (size_t)(end - len.p) < n) {
+                fail("Truncated record");
+                break;
+            }
+            Reader in{len.p, len.p + n};
+            row = Row();
+            if (decodeBinary(in, row)) insert(row);
+            else result.skipped++;
+            p = len.p + n;
+        }
+    }
+
+    if (result.ok && in_txn) {
+        if (sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) == SQLITE_OK) result.imported += (long long)pending;
+        else fail(sqlite3_errmsg(db));
+    }
+    sqlite3_finalize(ins);
+    return result;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <sqlite3.h>
+
+// Bulk export and import of ended games, for backups, analytics pipelines
+// and seeding test instances.
+//
+// NDJSON: one object per game, with the stored board and move log.
+//
+// Binary: the magic "OTHARC01", then one record per game, little-endian:
+//   u32  length of the rest of the record
+//   i64  id, created_at, updated_at
+//   str  status, player1, player2, winner   (u16 length + bytes)
+//   u8   board size, then 2 bits per square row by row, first square in
+//        the low bits (0 empty, 1 side 1, 2 side -1)
+//   u16  move count, then one byte per turn: the square, or 255 for a pass
+// Flip masks are left out and recomputed by replaying the moves on import.
+//
+// Both formats are checked the same way on import: the status must be one
+// of an ended game, and the moves must replay from the start position to
+// the stored board (games without a move log keep their board as given).
+// Imported games are history only: they don't change player stats,
+// ratings, the leaderboard or the position index, and are stored as
+// already booked so the server's startup pass leaves them alone.
+class GameArchive {
+public:
+    enum class Format { Ndjson, Binary };
+
+    struct ImportResult {
+        bool ok = true;
+        std::string error;
+        long long imported = 0;
+        long long skipped = 0; // not ended, malformed or not replayable
+    };
+
+    // Writes every game that has ended to `path`, reading through one
+    // cursor so memory use stays flat however big the table is. Returns
+    // the number of games written, or -1 on error. The cursor stays open
+    // throughout, so give `db` a connection of its own: on a shared one,
+    // other threads' writes would pile up in one uncommitted transaction.
+    static long long exportTo(sqlite3* db, const std::string& path, Format format);
+
+    // Inserts the games in `data` as new rows (ids are not kept),
+    // committing every `batch` games. Transactions belong to a connection,
+    // so `db` must not be shared with other threads meanwhile.
+    static ImportResult importFrom(sqlite3* db, const std::string& data, Format format, size_t batch = 1000);
+};
@@ -1,4 +1,6 @@
 #include "auth.h"
+#include "metrics.h"
+#include "tracing.h"
 #include <sodium.h>
 #include <ctime>
 #include <sstream>
@@ -26,6 +28,11 @@ static std::string random_sid_hex() {
     return oss.str();
 }
 
+static int prepare(sqlite3* db, const char* sql, sqlite3_stmt** stmt) {
+    TraceSpan span("sqlite.prepare");
+    return sqlite3_prepare_v2(db, sql, -1, stmt, nullptr);
+}
+
 static bool exec_sql(sqlite3* db, const char* sql) {
     char* err = nullptr;
     int rc = sqlite3_exec(db, sql, nullptr, nullptr, &err);
@@ -61,16 +68,23 @@ AuthResult register_user(sqlite3* db, const std::string& username, const std::st
         return {false, "username required and password must be >= 6 chars"};
     }
 
+    static const int hash_time = Metrics::histogram("auth_password_hash_duration_seconds", "Time spent in libsodium password hashing.", "op=\"hash\"");
     char hash[crypto_pwhash_STRBYTES];
-    if (crypto_pwhash_str(hash, password.c_str(), password.size(),
-                          crypto_pwhash_OPSLIMIT_INTERACTIVE,
-                          crypto_pwhash_MEMLIMIT_INTERACTIVE) != 0) {
+    int hash_rc;
+    {
+        ScopedTimer t(hash_time);
+        TraceSpan span("auth.pwhash");
+        hash_rc = crypto_pwhash_str(hash, password.c_str(), password.size(),
+                                    crypto_pwhash_OPSLIMIT_INTERACTIVE,
+                                    crypto_pwhash_MEMLIMIT_INTERACTIVE);
+    }
+    if (hash_rc != 0) {
         return {false, "password hashing failed"};
     }
 
     sqlite3_stmt* stmt = nullptr;
     const char* sql = "INSERT INTO users(username, pw_hash, created_at) VALUES(?,?,?);";
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+    if (prepare(db, sql, &stmt) != SQLITE_OK) {
         return {false, "db prepare failed"};
     }
 
@@ -88,7 +102,7 @@ AuthResult register_user(sqlite3* db, const std::string& username, const std::st
 std::optional<std::string> login_user(sqlite3* db, const std::string& username, const std::string& password) {
     sqlite3_stmt* stmt = nullptr;
     const char* sql = "SELECT pw_hash FROM users WHERE username=?;";
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return std::nullopt;
+    if (prepare(db, sql, &stmt) != SQLITE_OK) return std::nullopt;
 
     sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
 
@@ -98,7 +112,13 @@ std::optional<std::string> login_user(sqlite3* db, const std::string& username,
     const char* hash = (const char*)sqlite3_column_text(stmt, 0);
     if (!hash) { sqlite3_finalize(stmt); return std::nullopt; }
 
-    bool ok = (crypto_pwhash_str_verify(hash, password.c_str(), password.size()) == 0);
+    static const int verify_time = Metrics::histogram("auth_password_hash_duration_seconds", "Time spent in libsodium password hashing.", "op=\"verify\"");
+    bool ok;
+    {
+        ScopedTimer t(verify_time);
+        TraceSpan span("auth.pwhash_verify");
+        ok = (crypto_pwhash_str_verify(hash, password.c_str(), password.size()) == 0);
+    }
     sqlite3_finalize(stmt);
     if (!ok) return std::nullopt;
 
@@ -109,7 +129,7 @@ std::optional<std::string> login_user(sqlite3* db, const std::string& username,
 
     sqlite3_stmt* ins = nullptr;
     const char* ins_sql = "INSERT INTO sessions(sid, username, created_at, expires_at) VALUES(?,?,?,?);";
-    if (sqlite3_prepare_v2(db, ins_sql, -1, &ins, nullptr) != SQLITE_OK) return std::nullopt;
+    if (prepare(db, ins_sql, &ins) != SQLITE_OK) return std::nullopt;
 
     sqlite3_bind_text(ins, 1, sid.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(ins, 2, username.c_str(), -1, SQLITE_TRANSIENT);
@@ -124,12 +144,16 @@ std::optional<std::string> login_user(sqlite3* db, const std::string& username,
 }
 
 std::optional<std::string> require_user(sqlite3* db, const std::string& cookie_header) {
+    static const int require_time = Metrics::histogram("auth_require_user_duration_seconds", "Time spent resolving a session cookie to a user.");
+    ScopedTimer t(require_time);
+    TraceSpan span("auth.require_user");
+
     std::string sid = get_cookie_value(cookie_header, "sid");
     if (sid.empty()) return std::nullopt;
 
     sqlite3_stmt* stmt = nullptr;
     const char* sql = "SELECT username, expires_at FROM sessions WHERE sid=?;";
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return std::nullopt;
+    if (prepare(db, sql, &stmt) != SQLITE_OK) return std::nullopt;
 
     sqlite3_bind_text(stmt, 1, sid.c_str(), -1, SQLITE_TRANSIENT);
 
@@ -149,7 +173,7 @@ std::optional<std::string> require_user(sqlite3* db, const std::string& cookie_h
     if ((sqlite3_int64)std::time(nullptr) > exp) {
         // expired -> delete it
         sqlite3_stmt* del = nullptr;
-        if (sqlite3_prepare_v2(db, "DELETE FROM sessions WHERE sid=?;", -1, &del, nullptr) == SQLITE_OK) {
+        if (prepare(db, "DELETE FROM sessions WHERE sid=?;", &del) == SQLITE_OK) {
             sqlite3_bind_text(del, 1, sid.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_step(del);
             sqlite3_finalize(del);
@@ -165,7 +189,7 @@ void logout_user(sqlite3* db, const std::string& cookie_header) {
     if (sid.empty()) return;
 
     sqlite3_stmt* del = nullptr;
-    if (sqlite3_prepare_v2(db, "DELETE FROM sessions WHERE sid=?;", -1, &del, nullptr) != SQLITE_OK) return;
+    if (prepare(db, "DELETE FROM sessions WHERE sid=?;", &del) != SQLITE_OK) return;
     sqlite3_bind_text(del, 1, sid.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_step(del);
     sqlite3_finalize(del);
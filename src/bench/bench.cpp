@@ -0,0 +1,209 @@
+// Microbenchmarks for the core components.
+//
+// Prints one JSON object per benchmark per line, e.g.
+//   {"name":"board.anyMoves","iterations":1048576,"ns_per_op":41.2,"ops_per_sec":24271844.7}
+// so runs can be appended to a file and compared over time.
+//
+// Usage: ./bench [--filter SUBSTRING] [--min-time SECONDS] [--db PATH]
+// The auth benchmarks create a bench user and session in --db
+// (default bench.db). Point it at a copy of app.db to time a realistic
+// sessions table.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sodium.h>
+#include <sqlite3.h>
+
+#include "auth.h"
+#include "board/board.h"
+#include "board/board_json.h"
+#include "analysis/position_analysis.h"
+#include "number_reverser.h"
+#include "text_analyzer.h"
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+struct Options {
+    string filter;
+    double min_time = 0.5;
+    string db_path = "bench.db";
+};
+
+// Keeps the optimizer from deleting the work being measured.
+static volatile long long sink;
+
+static void run(const Options& opt, const string& name, const function<void()>& op) {
+    if (!opt.filter.empty() && name.find(opt.filter) == string::npos) return;
+
+    op(); // warm up
+
+    // Double the batch until a batch takes at least min_time.
+    long long iters = 1;
+    double elapsed = 0;
+    while (true) {
+        auto start = Clock::now();
+        for (long long i = 0; i < iters; i++) op();
+        elapsed = chrono::duration<double>(Clock::now() - start).count();
+        if (elapsed >= opt.min_time || iters >= (1LL << 40)) break;
+        iters *= 2;
+    }
+
+    double ns = elapsed * 1e9 / (double)iters;
+    printf("{\"name\":\"%s\",\"iterations\":%lld,\"ns_per_op\":%.1f,\"ops_per_sec\":%.1f}\n",
+           name.c_str(), iters, ns, 1e9 / ns);
+    fflush(stdout);
+}
+
+// A position reached by playing `plies` random legal moves from the start.
+static vector<vector<int>> random_position(int plies, unsigned seed) {
+    mt19937 rng(seed);
+    Board board;
+    int side = 1;
+    for (int p = 0; p < plies; p++) {
+        vector<pair<int, int>> moves;
+        for (int r = 0; r < 8; r++) {
+            for (int c = 0; c < 8; c++) {
+                if (board.at(r, c) == 0 && board.flipVectors(r, c, side, false)) moves.push_back({r, c});
+            }
+        }
+        if (!moves.empty()) {
+            auto m = moves[rng() % moves.size()];
+            board.addPiece(m.first, m.second, side);
+        }
+        side = -side;
+    }
+    return board.getBoard();
+}
+
+static void bench_board(const Options& opt) {
+    auto mid = random_position(20, 42);
+    int side = 1;
+
+    vector<pair<int, int>> moves;
+    {
+        Board b;
+        b.setBoard(mid);
+        for (int r = 0; r < 8; r++) {
+            for (int c = 0; c < 8; c++) {
+                if (mid[r][c] == 0 && b.flipVectors(r, c, side, false)) moves.push_back({r, c});
+            }
+        }
+    }
+    if (moves.empty()) return;
+
+    Board board;
+    board.setBoard(mid);
+    size_t next = 0;
+    run(opt, "board.addPiece_undo", [&] {
+        auto m = moves[next++ % moves.size()];
+        uint64_t flips = board.addPiece(m.first, m.second, side);
+        board.undoPiece(m.first, m.second, flips);
+        sink = (long long)flips;
+    });
+
+    board.setBoard(mid);
+    run(opt, "board.anyMoves", [&] { sink = board.anyMoves(side); });
+    run(opt, "board.calcWinner", [&] { sink = board.calcWinner(); });
+
+    BasicBoard<10> large;
+    run(opt, "board10.anyMoves", [&] { sink = large.anyMoves(side); });
+
+    string encoded;
+    for (const auto& row : mid) {
+        for (int v : row) encoded += v == 1 ? 'X' : (v == -1 ? 'O' : '-');
+    }
+    run(opt, "analysis.search_depth3", [&] { sink = PositionAnalyzer::analyze(encoded, 3).score; });
+
+    run(opt, "board_json.roundtrip", [&] {
+        auto decoded = board_from_json(board_to_json(mid));
+        sink = (long long)decoded.size();
+    });
+}
+
+static void bench_auth(const Options& opt) {
+    const bool want_auth = opt.filter.empty() || string("auth.require_user").find(opt.filter) != string::npos
+                        || string("auth.crypto_pwhash_str").find(opt.filter) != string::npos;
+    if (!want_auth) return;
+
+    sqlite3* db = nullptr;
+    if (sqlite3_open(opt.db_path.c_str(), &db) != SQLITE_OK) {
+        fprintf(stderr, "Failed to open %s\n", opt.db_path.c_str());
+        return;
+    }
+    auto init = init_auth(db);
+    if (!init.ok) {
+        fprintf(stderr, "%s\n", init.message.c_str());
+        sqlite3_close(db);
+        return;
+    }
+
+    register_user(db, "bench_user", "bench-password"); // fails harmlessly if it exists
+    auto sid = login_user(db, "bench_user", "bench-password");
+    if (!sid) {
+        fprintf(stderr, "bench login failed; is bench_user's password different in %s?\n", opt.db_path.c_str());
+    } else {
+        string cookie = "sid=" + *sid;
+        run(opt, "auth.require_user", [&] { sink = (long long)require_user(db, cookie).has_value(); });
+        logout_user(db, cookie);
+    }
+    sqlite3_close(db);
+
+    const string password = "correct horse battery staple";
+    char hash[crypto_pwhash_STRBYTES];
+    run(opt, "auth.crypto_pwhash_str", [&] {
+        sink = crypto_pwhash_str(hash, password.c_str(), password.size(),
+                                 crypto_pwhash_OPSLIMIT_INTERACTIVE,
+                                 crypto_pwhash_MEMLIMIT_INTERACTIVE);
+    });
+}
+
+static void bench_numbers(const Options& opt) {
+    vector<int> nums(1 << 20);
+    for (size_t i = 0; i < nums.size(); i++) nums[i] = (int)i;
+
+    run(opt, "number_reverser.reverse_1m", [&] { sink = NumberReverser::reverse(nums)[0]; });
+    run(opt, "number_reverser.reverseInPlace_1m", [&] {
+        NumberReverser::reverseInPlace(nums);
+        sink = nums[0];
+    });
+
+    string text(1 << 20, 'x');
+    mt19937 rng(7);
+    for (char& c : text) c = (char)(' ' + rng() % 95);
+    run(opt, "text_analyzer.countVowels_1m", [&] { sink = TextAnalyzer::countVowels(text); });
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        string a = argv[i];
+        if (i + 1 >= argc) {
+            fprintf(stderr, "usage: %s [--filter SUBSTRING] [--min-time SECONDS] [--db PATH]\n", argv[0]);
+            return 2;
+        }
+        if (a == "--filter") opt.filter = argv[++i];
+        else if (a == "--min-time") opt.min_time = atof(argv[++i]);
+        else if (a == "--db") opt.db_path = argv[++i];
+        else {
+            fprintf(stderr, "unknown option %s\n", a.c_str());
+            return 2;
+        }
+    }
+
+    if (sodium_init() < 0) {
+        fprintf(stderr, "libsodium init failed\n");
+        return 1;
+    }
+
+    bench_board(opt);
+    bench_auth(opt);
+    bench_numbers(opt);
+    return 0;
+}
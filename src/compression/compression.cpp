@@ -0,0 +1,60 @@
+#include "compression.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <zlib.h>
+
+using namespace std;
+
+namespace {
+struct DeflateStream {
+    z_stream z{};
+    bool ok;
+
+    // 15 window bits plus 16 asks for a gzip header rather than zlib's
+    DeflateStream() : ok(deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK) {}
+    ~DeflateStream() {
+        if (ok) deflateEnd(&z);
+    }
+};
+}
+
+bool Gzip::compress(const string& in, string& out) {
+    thread_local DeflateStream stream;
+    if (!stream.ok || in.size() > 0xffffffffu) return false;
+    z_stream& z = stream.z;
+    if (deflateReset(&z) != Z_OK) return false;
+
+    out.resize(deflateBound(&z, (uLong)in.size()));
+    z.next_in = (Bytef*)in.data();
+    z.avail_in = (uInt)in.size();
+    z.next_out = (Bytef*)&out[0];
+    z.avail_out = (uInt)out.size();
+    // The bound guarantees a single call finishes
+    if (deflate(&z, Z_FINISH) != Z_STREAM_END) return false;
+    out.resize(z.total_out);
+    return true;
+}
+
+bool Gzip::accepted(const string& header) {
+    size_t pos = 0;
+    while (pos < header.size()) {
+        size_t end = header.find(',', pos);
+        if (end == string::npos) end = header.size();
+        string item = header.substr(pos, end - pos);
+        pos = end + 1;
+
+        // "gzip", "gzip;q=0.5", " * ;q=0"
+        size_t semi = item.find(';');
+        string coding = item.substr(0, semi);
+        string token;
+        for (char c : coding) {
+            if (!isspace((unsigned char)c)) token += (char)tolower((unsigned char)c);
+        }
+        if (token != "gzip" && token != "x-gzip" && token != "*") continue;
+        if (semi == string::npos) return true;
+        size_t q = item.find("q=", semi);
+        return q == string::npos || atof(item.c_str() + q + 2) > 0;
+    }
+    return false;
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// gzip for HTTP responses. Each thread keeps one deflate stream and resets
+// it between responses: setting a stream up allocates about 256KB, too
+// much to do per request.
+class Gzip {
+public:
+    // Compresses `in` into `out` as a gzip member; false if zlib failed
+    static bool compress(const std::string& in, std::string& out);
+    // Whether an Accept-Encoding header value allows gzip
+    static bool accepted(const std::string& accept_encoding);
+};
@@ -0,0 +1,32 @@
+#include "compression_middleware.h"
+#include "compression.h"
+#include "metrics.h"
+
+using namespace std;
+
+static bool compressible(const string& content_type) {
+    // Crow sends bodies without a type as text/html
+    return content_type.empty() || content_type.compare(0, 5, "text/") == 0
+        || content_type.compare(0, 16, "application/json") == 0
+        || content_type.compare(0, 20, "application/x-ndjson") == 0;
+}
+
+void CompressionMiddleware::before_handle(crow::request&, crow::response&, context&) {}
+
+void CompressionMiddleware::after_handle(crow::request& req, crow::response& res, context&) {
+    static const int bytes_in = Metrics::counter("http_gzip_input_bytes_total", "Response bytes before gzip.");
+    static const int bytes_out = Metrics::counter("http_gzip_output_bytes_total", "Response bytes after gzip.");
+
+    if (res.body.size() < min_size || res.is_static_type()) return;
+    if (!res.get_header_value("Content-Encoding").empty()) return;
+    if (!compressible(res.get_header_value("Content-Type"))) return;
+    res.add_header("Vary", "Accept-Encoding");
+    if (!Gzip::accepted(req.get_header_value("Accept-Encoding"))) return;
+
+    string gz;
+    if (!Gzip::compress(res.body, gz) || gz.size() >= res.body.size()) return;
+    Metrics::inc(bytes_in, res.body.size());
+    Metrics::inc(bytes_out, gz.size());
+    res.body = std::move(gz);
+    res.set_header("Content-Encoding", "gzip");
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <crow.h>
+#include <cstddef>
+
+// Gzips text and JSON responses of at least `min_size` bytes for clients
+// that accept it. Smaller bodies go out as they are: they fit in a packet
+// or two anyway, so compressing them costs more CPU than it saves.
+// Static files and responses that already set Content-Encoding are left
+// alone.
+struct CompressionMiddleware {
+    struct context {};
+
+    size_t min_size = 1024;
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+};
@@ -0,0 +1,112 @@
+#include "executor.h"
+#include <cstdlib>
+#include <iostream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+Executor::Executor(int threads, size_t max_queue, const vector<int>& cpus) : max_queue(max_queue) {
+    if (threads < 1) threads = 1;
+    for (int i = 0; i < threads; i++) {
+        int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        workers.emplace_back([this, cpu] { workerLoop(cpu); });
+    }
+}
+
+Executor::~Executor() {
+    shutdown();
+}
+
+void Executor::shutdown() {
+    deque<function<void()>> dropped;
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+        dropped.swap(queue);
+    }
+    cv.notify_all();
+    for (auto& t : workers) {
+        if (t.joinable()) t.join();
+    }
+    // Destroyed outside the lock: jobs may own things that submit more
+}
+
+bool Executor::submit(function<void()> job) {
+    {
+        lock_guard<mutex> lock(mtx);
+        if (stopping || queue.size() >= max_queue) return false;
+        queue.push_back(std::move(job));
+    }
+    cv.notify_one();
+    return true;
+}
+
+size_t Executor::queued() {
+    lock_guard<mutex> lock(mtx);
+    return queue.size();
+}
+
+void Executor::workerLoop(int cpu) {
+    if (cpu >= 0) pin_current_thread({cpu});
+    while (true) {
+        function<void()> job;
+        {
+            unique_lock<mutex> lock(mtx);
+            cv.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+        // An escaping exception would terminate the process. Jobs are
+        // expected to report their own errors; log whatever gets through.
+        try {
+            job();
+        } catch (const exception& e) {
+            cerr << "Background job failed: " << e.what() << "\n";
+        } catch (...) {
+            cerr << "Background job failed: unknown exception\n";
+        }
+    }
+}
+
+vector<int> parse_cpu_list(const string& spec) {
+    vector<int> cpus;
+    size_t pos = 0;
+    while (pos < spec.size()) {
+        size_t end = spec.find(',', pos);
+        if (end == string::npos) end = spec.size();
+        string part = spec.substr(pos, end - pos);
+        size_t dash = part.find('-');
+        const char* begin = part.c_str();
+        char* stop = nullptr;
+        long lo = strtol(begin, &stop, 10);
+        long hi = lo;
+        if (dash != string::npos) {
+            if (stop != begin + dash) return {};
+            hi = strtol(begin + dash + 1, &stop, 10);
+        }
+        if (part.empty() || *stop != '\0' || lo < 0 || hi < lo || hi > 4095) return {};
+        for (long c = lo; c <= hi; c++) cpus.push_back((int)c);
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+bool pin_current_thread(const vector<int>& cpus) {
+#ifdef __linux__
+    if (cpus.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus) {
+        if (c < CPU_SETSIZE) CPU_SET(c, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads with a bounded queue, used to keep blocking
+// work (SQLite, password hashing) off Crow's I/O threads.
+class Executor {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> queue;
+    std::mutex mtx;
+    std::condition_variable cv;
+    size_t max_queue;
+    bool stopping = false;
+
+    void workerLoop(int cpu);
+public:
+    // `cpus` lists the CPUs to pin workers to, round-robin; empty = no pinning
+    Executor(int threads, size_t max_queue, const std::vector<int>& cpus = {});
+    // Same as shutdown()
+    ~Executor();
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    // Returns false without queuing when the queue is full
+    bool submit(std::function<void()> job);
+    // Drops whatever is still queued, lets running jobs finish and joins
+    // the workers; submit() fails from then on. Call it before anything
+    // the queued jobs refer to goes away. Safe to call more than once.
+    void shutdown();
+    size_t queued();
+};
+
+// Parses a CPU list like "0-3,6". Returns an empty list on bad input.
+std::vector<int> parse_cpu_list(const std::string& spec);
+
+// Restricts the calling thread (and threads it creates afterwards) to
+// `cpus`. Linux only; elsewhere returns false and does nothing.
+bool pin_current_thread(const std::vector<int>& cpus);
@@ -0,0 +1,64 @@
+#include "game_clock.h"
+
+#include <chrono>
+
+using namespace std;
+
+int64_t MoveClock::nowMs() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+int64_t MoveClock::remaining(int side, int64_t now, int64_t untimed_limit_ms) const {
+    int64_t used = now > turn_started_ms ? now - turn_started_ms : 0;
+    int64_t bank = timed ? (side == 1 ? p1_ms : p2_ms) : untimed_limit_ms;
+    return bank - used;
+}
+
+bool MoveClock::endTurn(int side, int64_t now, int64_t untimed_limit_ms) {
+    int64_t left = remaining(side, now, untimed_limit_ms);
+    if (left <= 0) return false;
+    if (timed) {
+        (side == 1 ? p1_ms : p2_ms) = left + increment_ms;
+    }
+    turn_started_ms = now;
+    return true;
+}
+
+GameTimers::GameTimers(TimingWheel& wheel, function<void(int)> on_expire)
+    : wheel(wheel), on_expire(std::move(on_expire)) {}
+
+void GameTimers::arm(int game_id, int64_t delay_ms) {
+    lock_guard<mutex> lock(mtx);
+    auto it = timers.find(game_id);
+    if (it != timers.end()) wheel.cancel(it->second.id);
+
+    // The sequence number lets a timer that fires while being replaced
+    // tell that its entry is no longer its own.
+    uint64_t seq = next_seq++;
+    auto id = wheel.schedule(chrono::milliseconds(delay_ms > 0 ? delay_ms : 0),
+                             [this, game_id, seq] { fire(game_id, seq); });
+    timers[game_id] = Entry{id, seq};
+}
+
+void GameTimers::disarm(int game_id) {
+    lock_guard<mutex> lock(mtx);
+    auto it = timers.find(game_id);
+    if (it == timers.end()) return;
+    wheel.cancel(it->second.id);
+    timers.erase(it);
+}
+
+size_t GameTimers::armed() {
+    lock_guard<mutex> lock(mtx);
+    return timers.size();
+}
+
+void GameTimers::fire(int game_id, uint64_t seq) {
+    {
+        lock_guard<mutex> lock(mtx);
+        auto it = timers.find(game_id);
+        if (it == timers.end() || it->second.seq != seq) return;
+        timers.erase(it);
+    }
+    on_expire(game_id);
+}
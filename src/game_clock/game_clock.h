@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+#include "timing_wheel.h"
+
+// Per-game move clocks. Times are wall-clock milliseconds so they can be
+// stored in the games table and survive a restart.
+//
+// A timed game gives each player a bank of time that runs while they are
+// on move, plus `increment_ms` after each of their moves (Fischer). An
+// untimed game still has a per-move limit so abandoned games end.
+struct MoveClock {
+    bool timed = false;
+    int64_t p1_ms = 0;
+    int64_t p2_ms = 0;
+    int64_t increment_ms = 0;
+    int64_t turn_started_ms = 0;
+
+    static int64_t nowMs();
+
+    // Time `side` (1 or -1) has left at `now` if it has been on move since
+    // turn_started_ms. Untimed games get `untimed_limit_ms` per move.
+    int64_t remaining(int side, int64_t now, int64_t untimed_limit_ms) const;
+
+    // Ends `side`'s turn at `now`: charges the time used, adds the
+    // increment and starts the opponent's turn. Returns false, leaving the
+    // clock untouched, if the flag fell first.
+    bool endTurn(int side, int64_t now, int64_t untimed_limit_ms);
+};
+
+// Keeps at most one pending deadline per game on a TimingWheel. Arming,
+// re-arming and disarming are O(1). `on_expire` runs on the wheel's thread
+// and must hand any blocking work off. Thread-safe.
+class GameTimers {
+public:
+    GameTimers(TimingWheel& wheel, std::function<void(int game_id)> on_expire);
+
+    // Replaces any pending deadline for the game
+    void arm(int game_id, int64_t delay_ms);
+    void disarm(int game_id);
+    size_t armed();
+
+private:
+    struct Entry {
+        TimingWheel::TimerId id;
+        uint64_t seq;
+    };
+
+    TimingWheel& wheel;
+    std::function<void(int)> on_expire;
+    std::mutex mtx;
+    std::unordered_map<int, Entry> timers;
+    uint64_t next_seq = 1;
+
+    void fire(int game_id, uint64_t seq);
+};
@@ -0,0 +1,37 @@
+#include "leaderboard.h"
+
+#include <cmath>
+
+using namespace std;
+
+void Leaderboard::update(const PlayerStats& stats) {
+    lock_guard<mutex> lock(mtx);
+    auto it = players.find(stats.username);
+    if (it != players.end()) {
+        by_rating.erase({-it->second.rating, stats.username});
+        it->second = stats;
+    } else {
+        players.emplace(stats.username, stats);
+    }
+    by_rating.insert({-stats.rating, stats.username});
+}
+
+vector<PlayerStats> Leaderboard::top(size_t k) {
+    lock_guard<mutex> lock(mtx);
+    vector<PlayerStats> out;
+    out.reserve(k < by_rating.size() ? k : by_rating.size());
+    for (auto it = by_rating.begin(); it != by_rating.end() && out.size() < k; ++it) {
+        out.push_back(players[it->second]);
+    }
+    return out;
+}
+
+size_t Leaderboard::size() {
+    lock_guard<mutex> lock(mtx);
+    return players.size();
+}
+
+int elo_delta(int rating, int opponent, double score, int k) {
+    double expected = 1.0 / (1.0 + pow(10.0, (opponent - rating) / 400.0));
+    return (int)lround(k * (score - expected));
+}
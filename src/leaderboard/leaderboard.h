@@ -0,0 +1,37 @@
+#pragma once
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct PlayerStats {
+    std::string username;
+    int rating = 1200;
+    int wins = 0;
+    int losses = 0;
+    int draws = 0;
+    int resignations = 0; // games this player resigned, also counted as losses
+};
+
+// Players who have finished a game, kept ordered by rating so the top K
+// can be read in O(K) without touching the games table. Updated in place
+// as each game ends (O(log n)); the player_stats table is the durable copy
+// it is loaded from at startup. Thread-safe.
+class Leaderboard {
+public:
+    void update(const PlayerStats& stats);
+    // The `k` highest rated players, best first; ties by name
+    std::vector<PlayerStats> top(size_t k);
+    size_t size();
+
+private:
+    std::mutex mtx;
+    std::unordered_map<std::string, PlayerStats> players;
+    std::set<std::pair<int, std::string>> by_rating; // (-rating, name)
+};
+
+// Elo rating change for a player rated `rating` against `opponent`, given
+// score 1 (win), 0.5 (draw) or 0 (loss).
+int elo_delta(int rating, int opponent, double score, int k = 32);
@@ -0,0 +1,433 @@
+// Load generator: simulates N players against a running server.
+//
+// Each simulated user registers (or logs in), pairs up with a partner
+// through /api/games/create, and then behaves like public/index.html: it
+// polls /api/games/<id>/state on a fixed interval and plays a random legal
+// move when it is its turn. When a game ends the pair starts a new one.
+//
+// Usage: ./loadtest [--host 127.0.0.1] [--port 18080] [--users 20]
+//                   [--duration 60] [--ramp 5] [--poll-ms 1500]
+//                   [--think-ms 200] [--prefix lt] [--seed 1] [--json]
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <csignal>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "board/board.h"
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+struct Options {
+    string host = "127.0.0.1";
+    int port = 18080;
+    int users = 20;
+    int duration = 60;
+    int ramp = 5;
+    int poll_ms = 1500;
+    int think_ms = 200;
+    string prefix = "lt";
+    unsigned seed = 1;
+    bool json = false;
+};
+
+struct HttpResponse {
+    int status = 0; // 0 = transport error
+    string body;
+    string set_cookie;
+};
+
+// Minimal blocking HTTP/1.1 client with a kept-alive connection.
+class HttpClient {
+private:
+    string host;
+    int port;
+    int fd = -1;
+
+    bool connectSocket() {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* res = nullptr;
+        if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &res) != 0) return false;
+        for (addrinfo* a = res; a; a = a->ai_next) {
+            fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd < 0) continue;
+            if (connect(fd, a->ai_addr, a->ai_addrlen) == 0) break;
+            close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(res);
+        if (fd < 0) return false;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return true;
+    }
+
+    void disconnect() {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+
+    bool sendAll(const string& data) {
+        size_t off = 0;
+        while (off < data.size()) {
+            ssize_t n = send(fd, data.data() + off, data.size() - off, 0);
+            if (n <= 0) return false;
+            off += (size_t)n;
+        }
+        return true;
+    }
+
+    bool readResponse(HttpResponse& out) {
+        string buf;
+        char chunk[8192];
+        size_t header_end = string::npos;
+        while (header_end == string::npos) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) return false;
+            buf.append(chunk, (size_t)n);
+            header_end = buf.find("\r\n\r\n");
+        }
+
+        if (buf.compare(0, 5, "HTTP/") != 0) return false;
+        out.status = atoi(buf.c_str() + buf.find(' ') + 1);
+
+        size_t content_length = 0;
+        bool keep_alive = true;
+        size_t pos = buf.find("\r\n") + 2;
+        while (pos < header_end) {
+            size_t eol = buf.find("\r\n", pos);
+            string line = buf.substr(pos, eol - pos);
+            size_t colon = line.find(':');
+            if (colon != string::npos) {
+                string name = line.substr(0, colon);
+                string value = line.substr(colon + 1);
+                while (!value.empty() && value.front() == ' ') value.erase(value.begin());
+                transform(name.begin(), name.end(), name.begin(), ::tolower);
+                if (name == "content-length") content_length = strtoul(value.c_str(), nullptr, 10);
+                else if (name == "set-cookie") out.set_cookie = value;
+                else if (name == "connection" && value.find("close") != string::npos) keep_alive = false;
+            }
+            pos = eol + 2;
+        }
+
+        out.body = buf.substr(header_end + 4);
+        while (out.body.size() < content_length) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) return false;
+            out.body.append(chunk, (size_t)n);
+        }
+        out.body.resize(content_length);
+        if (!keep_alive) disconnect();
+        return true;
+    }
+
+public:
+    HttpClient(const string& host, int port) : host(host), port(port) {}
+    ~HttpClient() { disconnect(); }
+
+    HttpResponse request(const string& method, const string& path, const string& cookie, const string& body) {
+        string req = method + " " + path + " HTTP/1.1\r\nHost: " + host + "\r\n";
+        if (!cookie.empty()) req += "Cookie: " + cookie + "\r\n";
+        if (method == "POST") {
+            req += "Content-Type: application/json\r\nContent-Length: " + to_string(body.size()) + "\r\n";
+        }
+        req += "\r\n" + body;
+
+        // One retry covers the server closing an idle keep-alive connection.
+        for (int attempt = 0; attempt < 2; attempt++) {
+            if (fd < 0 && !connectSocket()) break;
+            HttpResponse res;
+            if (sendAll(req) && readResponse(res)) return res;
+            disconnect();
+        }
+        return HttpResponse{};
+    }
+};
+
+// Latency samples for one endpoint, in microseconds
+struct EndpointStats {
+    vector<uint32_t> samples;
+    uint64_t errors = 0;
+};
+
+class Recorder {
+private:
+    mutex mtx;
+    map<string, EndpointStats> stats;
+public:
+    void merge(const map<string, EndpointStats>& local) {
+        lock_guard<mutex> lock(mtx);
+        for (const auto& kv : local) {
+            EndpointStats& s = stats[kv.first];
+            s.samples.insert(s.samples.end(), kv.second.samples.begin(), kv.second.samples.end());
+            s.errors += kv.second.errors;
+        }
+    }
+
+    map<string, EndpointStats>& all() { return stats; }
+};
+
+static long json_int(const string& body, const string& key, long fallback) {
+    string needle = "\"" + key + "\":";
+    size_t pos = body.find(needle);
+    if (pos == string::npos) return fallback;
+    return strtol(body.c_str() + pos + needle.size(), nullptr, 10);
+}
+
+static string json_string(const string& body, const string& key) {
+    string needle = "\"" + key + "\":\"";
+    size_t pos = body.find(needle);
+    if (pos == string::npos) return "";
+    pos += needle.size();
+    size_t end = body.find('"', pos);
+    return end == string::npos ? "" : body.substr(pos, end - pos);
+}
+
+static vector<vector<int>> json_board(const string& body) {
+    vector<vector<int>> board;
+    size_t pos = body.find("\"board\":[");
+    if (pos == string::npos) return board;
+    pos += 9;
+    vector<int> row;
+    int depth = 1;
+    while (pos < body.size() && depth > 0) {
+        char c = body[pos];
+        if (c == '[') { depth++; row.clear(); pos++; }
+        else if (c == ']') { if (depth == 2) board.push_back(row); depth--; pos++; }
+        else if (c == '-' || (c >= '0' && c <= '9')) {
+            char* end = nullptr;
+            row.push_back((int)strtol(body.c_str() + pos, &end, 10));
+            pos = (size_t)(end - body.c_str());
+        } else pos++;
+    }
+    return board;
+}
+
+class SimulatedUser {
+private:
+    const Options& opt;
+    string name;
+    string partner;
+    bool creator;
+    HttpClient http;
+    string cookie;
+    mt19937 rng;
+    map<string, EndpointStats> stats;
+
+    HttpResponse call(const string& label, const string& method, const string& path, const string& body = "") {
+        auto start = Clock::now();
+        HttpResponse res = http.request(method, path, cookie, body);
+        auto us = chrono::duration_cast<chrono::microseconds>(Clock::now() - start).count();
+        EndpointStats& s = stats[label];
+        s.samples.push_back((uint32_t)min<long long>(us, UINT32_MAX));
+        if (res.status == 0 || res.status >= 500) s.errors++;
+        return res;
+    }
+
+    void sleepMs(int ms) {
+        this_thread::sleep_for(chrono::milliseconds(ms));
+    }
+
+    bool login() {
+        string creds = "{\"username\":\"" + name + "\",\"password\":\"loadtest-pw\"}";
+        call("/api/register", "POST", "/api/register", creds); // 400 if it already exists
+        HttpResponse res = call("/api/login", "POST", "/api/login", creds);
+        if (res.status != 200) return false;
+        size_t end = res.set_cookie.find(';');
+        cookie = res.set_cookie.substr(0, end);
+        return !cookie.empty();
+    }
+
+    int activeGame() {
+        HttpResponse res = call("/api/games/active", "GET", "/api/games/active");
+        if (res.status != 200) return 0;
+        return (int)json_int(res.body, "game_id", 0);
+    }
+
+    // Leftovers from an interrupted run would make create return 409.
+    void resignLeftovers() {
+        if (!creator) return;
+        int id = activeGame();
+        if (id) call("/api/games/<id>/resign", "POST", "/api/games/" + to_string(id) + "/resign");
+    }
+
+    int startGame(Clock::time_point deadline) {
+        while (Clock::now() < deadline) {
+            if (creator) {
+                HttpResponse res = call("/api/games/create", "POST", "/api/games/create",
+                                        "{\"opponent\":\"" + partner + "\"}");
+                if (res.status == 200) return (int)json_int(res.body, "game_id", 0);
+            } else {
+                int id = activeGame();
+                if (id) return id;
+            }
+            sleepMs(opt.poll_ms);
+        }
+        return 0;
+    }
+
+    void playGame(int game_id, Clock::time_point deadline) {
+        int side = creator ? 1 : -1;
+        string path = "/api/games/" + to_string(game_id);
+        while (Clock::now() < deadline) {
+            HttpResponse res = call("/api/games/<id>/state", "GET", path + "/state");
+            if (res.status != 200) { sleepMs(opt.poll_ms); continue; }
+            if (json_string(res.body, "status") != "active") return;
+
+            if (json_int(res.body, "turn", 0) == side) {
+                vector<vector<int>> cells = json_board(res.body);
+                vector<pair<int, int>> moves;
+                if (cells.size() == 8) {
+                    Board board;
+                    board.setBoard(cells);
+                    for (int r = 0; r < 8; r++) {
+                        for (int c = 0; c < 8; c++) {
+                            if (cells[r][c] == 0 && board.flipVectors(r, c, side, false)) moves.push_back({r, c});
+                        }
+                    }
+                }
+                // With no legal move the next state poll auto-passes.
+                if (!moves.empty()) {
+                    sleepMs(opt.think_ms);
+                    auto m = moves[rng() % moves.size()];
+                    call("/api/games/<id>/move", "POST", path + "/move",
+                         "{\"row\":" + to_string(m.first) + ",\"col\":" + to_string(m.second) + "}");
+                    continue;
+                }
+            }
+            sleepMs(opt.poll_ms);
+        }
+    }
+
+public:
+    SimulatedUser(const Options& opt, int index)
+        : opt(opt),
+          name(opt.prefix + "_" + to_string(index)),
+          partner(opt.prefix + "_" + to_string(index ^ 1)),
+          creator(index % 2 == 0),
+          http(opt.host, opt.port),
+          rng(opt.seed * 7919u + (unsigned)index) {}
+
+    void run(Clock::time_point start, Clock::time_point deadline, Recorder& recorder) {
+        this_thread::sleep_until(start);
+        if (!login()) {
+            fprintf(stderr, "%s: login failed\n", name.c_str());
+        } else {
+            resignLeftovers();
+            while (Clock::now() < deadline) {
+                int game_id = startGame(deadline);
+                if (!game_id) break;
+                playGame(game_id, deadline);
+            }
+        }
+        recorder.merge(stats);
+    }
+};
+
+static uint32_t percentile(const vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t i = (size_t)(p * (double)(sorted.size() - 1) + 0.5);
+    return sorted[min(i, sorted.size() - 1)];
+}
+
+static bool parse_args(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        string a = argv[i];
+        auto next = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char* v = nullptr;
+        if (a == "--json") { opt.json = true; continue; }
+        if (!(v = next())) return false;
+        if (a == "--host") opt.host = v;
+        else if (a == "--port") opt.port = atoi(v);
+        else if (a == "--users") opt.users = atoi(v);
+        else if (a == "--duration") opt.duration = atoi(v);
+        else if (a == "--ramp") opt.ramp = atoi(v);
+        else if (a == "--poll-ms") opt.poll_ms = atoi(v);
+        else if (a == "--think-ms") opt.think_ms = atoi(v);
+        else if (a == "--prefix") opt.prefix = v;
+        else if (a == "--seed") opt.seed = (unsigned)strtoul(v, nullptr, 10);
+        else return false;
+    }
+    // Users play in pairs.
+    if (opt.users % 2) opt.users++;
+    return opt.users > 0 && opt.duration > 0;
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        fprintf(stderr,
+                "usage: %s [--host H] [--port P] [--users N] [--duration S] [--ramp S]\n"
+                "          [--poll-ms MS] [--think-ms MS] [--prefix NAME] [--seed N] [--json]\n",
+                argv[0]);
+        return 2;
+    }
+
+    // A server closing the connection must not kill the run.
+    signal(SIGPIPE, SIG_IGN);
+
+    Recorder recorder;
+    vector<unique_ptr<SimulatedUser>> users;
+    for (int i = 0; i < opt.users; i++) users.push_back(make_unique<SimulatedUser>(opt, i));
+
+    // Logins are staggered over the ramp so password hashing doesn't
+    // dominate the first seconds of the run.
+    auto t0 = Clock::now();
+    auto deadline = t0 + chrono::seconds(opt.ramp + opt.duration);
+    vector<thread> threads;
+    for (int i = 0; i < opt.users; i++) {
+        auto start = t0 + chrono::milliseconds((long long)opt.ramp * 1000 * i / opt.users);
+        threads.emplace_back([&, i, start] { users[i]->run(start, deadline, recorder); });
+    }
+    for (auto& t : threads) t.join();
+    double elapsed = chrono::duration<double>(Clock::now() - t0).count();
+
+    if (opt.json) printf("{\"users\":%d,\"elapsed_s\":%.3f,\"endpoints\":[", opt.users, elapsed);
+    else printf("%-26s %9s %9s %7s %10s %10s %10s\n", "endpoint", "requests", "req/s", "errors", "p50 ms", "p99 ms", "p999 ms");
+
+    bool first = true;
+    uint64_t total = 0;
+    for (auto& kv : recorder.all()) {
+        auto& s = kv.second.samples;
+        sort(s.begin(), s.end());
+        total += s.size();
+        double rps = (double)s.size() / elapsed;
+        double p50 = percentile(s, 0.50) / 1000.0;
+        double p99 = percentile(s, 0.99) / 1000.0;
+        double p999 = percentile(s, 0.999) / 1000.0;
+        if (opt.json) {
+            printf("%s{\"endpoint\":\"%s\",\"requests\":%zu,\"rps\":%.2f,\"errors\":%llu,"
+                   "\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"p999_ms\":%.3f}",
+                   first ? "" : ",", kv.first.c_str(), s.size(), rps,
+                   (unsigned long long)kv.second.errors, p50, p99, p999);
+        } else {
+            printf("%-26s %9zu %9.1f %7llu %10.3f %10.3f %10.3f\n", kv.first.c_str(), s.size(), rps,
+                   (unsigned long long)kv.second.errors, p50, p99, p999);
+        }
+        first = false;
+    }
+
+    if (opt.json) printf("],\"total_requests\":%llu,\"rps\":%.2f}\n", (unsigned long long)total, (double)total / elapsed);
+    else printf("\ntotal: %llu requests in %.1fs (%.1f req/s)\n", (unsigned long long)total, elapsed, (double)total / elapsed);
+    return 0;
+}
@@ -1,15 +1,46 @@
 #include <crow.h>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <cctype>
+#include <charconv>
 #include <vector>
 #include <mutex>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <chrono>
 #include <ctime>
+#include <optional>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <set>
 #include <sstream>
+#include <sys/stat.h>
 #include "number_reverser.h"
+#include "text_analyzer.h"
 #include "othello/board/board.h"
+#include "othello/board/board_json.h"
+#include "othello/analysis/position_analysis.h"
 #include <sqlite3.h>
 #include "auth.h"
+#include "metrics.h"
+#include "metrics_middleware.h"
+#include "compression_middleware.h"
+#include "executor.h"
+#include "matchmaking.h"
+#include "timing_wheel.h"
+#include "game_clock.h"
+#include "spectator_hub.h"
+#include "leaderboard.h"
+#include "game_archive.h"
+#include "db_maintenance.h"
+#include "position_index.h"
+#include "prefork.h"
+#include "tracing.h"
+#include "trace_middleware.h"
 
 std::string readFile(const std::string& path) {
     std::ifstream f(path);
@@ -28,6 +59,15 @@ struct Submission {
 std::vector<Submission> submissions;
 std::mutex submissions_mtx;
 
+// Serialized states of games that spectators are watching.
+SpectatorHub spectators;
+
+// Everyone who has finished a game, by rating; loaded from player_stats.
+Leaderboard leaderboard;
+PositionIndex positions;
+// Link to the other worker processes when running with WORKERS set
+WorkerChannel* peers = nullptr;
+
 static bool exec_sql(sqlite3* db, const char* sql) {
     char* err = nullptr;
     int rc = sqlite3_exec(db, sql, nullptr, nullptr, &err);
@@ -35,63 +75,749 @@ static bool exec_sql(sqlite3* db, const char* sql) {
     return rc == SQLITE_OK;
 }
 
-static std::vector<std::vector<int>> initial_board() {
-    std::vector<std::vector<int>> b(8, std::vector<int>(8, 0));
-    b[3][3] = 1;
-    b[3][4] = -1;
-    b[4][3] = -1;
-    b[4][4] = 1;
-    return b;
-}
-
-static std::string board_to_json(const std::vector<std::vector<int>>& b) {
-    std::ostringstream oss;
-    oss << "[";
-    for (size_t r = 0; r < b.size(); r++) {
-        if (r) oss << ",";
-        oss << "[";
-        for (size_t c = 0; c < b[r].size(); c++) {
-            if (c) oss << ",";
-            oss << b[r][c];
+static int sqlite_profile(unsigned type, void*, void* p, void* x) {
+    static const int stmt_time = Metrics::histogram("sqlite_statement_duration_seconds", "Time spent running each SQLite statement.");
+    if (type != SQLITE_TRACE_PROFILE) return 0;
+    uint64_t ns = (uint64_t)*(sqlite3_int64*)x;
+    Metrics::observe(stmt_time, ns);
+    if (Tracer::current()) Tracer::record("sqlite.step", Tracer::nowNanos() - ns, ns, sqlite3_sql((sqlite3_stmt*)p));
+    return 0;
+}
+
+static int prepare(sqlite3* db, const char* sql, sqlite3_stmt** stmt) {
+    TraceSpan span("sqlite.prepare");
+    return sqlite3_prepare_v2(db, sql, -1, stmt, nullptr);
+}
+
+static crow::json::rvalue parse_json(const std::string& body) {
+    TraceSpan span("json.parse");
+    return crow::json::load(body);
+}
+
+// rvalue::s() and i() throw on a value of the wrong type, so check first
+static bool has_string(const crow::json::rvalue& body, const char* key) {
+    return body && body.t() == crow::json::type::Object && body.has(key) && body[key].t() == crow::json::type::String;
+}
+
+static bool has_number(const crow::json::rvalue& body, const char* key) {
+    return body && body.t() == crow::json::type::Object && body.has(key) && body[key].t() == crow::json::type::Number;
+}
+
+static crow::response to_response(crow::json::wvalue out, int code = 200) {
+    TraceSpan span("response.serialize");
+    return crow::response(code, out);
+}
+
+// Hands a handler's blocking work to `pool` and finishes `res` from the
+// worker thread when it returns. Crow keeps the connection and its request
+// alive until res.end(), so the job may use them by reference. A full
+// queue fails fast with 503 instead of stalling the I/O thread. Jobs run
+// outside Crow's router, which would otherwise turn an exception into a
+// 500, so that is done here.
+static void offload(Executor& pool, crow::response& res, std::function<crow::response()> job) {
+    uint64_t trace_id = Tracer::current();
+    bool queued = pool.submit([&res, job = std::move(job), trace_id] {
+        Tracer::setCurrent(trace_id);
+        try {
+            res = job();
+        } catch (const std::exception& e) {
+            std::cerr << "Handler failed: " << e.what() << "\n";
+            res = crow::response(500, "Internal error");
+        } catch (...) {
+            res = crow::response(500, "Internal error");
         }
-        oss << "]";
+        res.end();
+    });
+    if (!queued) {
+        res = crow::response(503, "Server busy");
+        res.end();
     }
-    oss << "]";
-    return oss.str();
 }
 
-static std::vector<std::vector<int>> board_from_json(const std::string& s) {
-    std::vector<std::vector<int>> out;
-    auto j = crow::json::load(s);
-    if (!j || j.t() != crow::json::type::List) return out;
-    out.resize(j.size());
-    for (size_t r = 0; r < j.size(); r++) {
-        out[r].resize(j[r].size());
-        for (size_t c = 0; c < j[r].size(); c++) {
-            out[r][c] = j[r][c].i();
+static int env_int(const char* name, int fallback) {
+    const char* v = std::getenv(name);
+    return (v && *v) ? std::atoi(v) : fallback;
+}
+
+// Users listed in ADMIN_USERS (comma-separated) may export and import
+// games, take backups and read /metrics and /debug/trace.
+static bool is_admin(const std::string& user) {
+    static const std::set<std::string> admins = [] {
+        std::set<std::string> out;
+        std::stringstream ss(std::getenv("ADMIN_USERS") ? std::getenv("ADMIN_USERS") : "");
+        std::string name;
+        while (std::getline(ss, name, ',')) {
+            if (!name.empty()) out.insert(name);
         }
+        return out;
+    }();
+    return admins.count(user) != 0;
+}
+
+// Per-move limit for untimed games, after which a silent player loses on
+// time (ABANDON_AFTER_S, default 3 days).
+static int64_t untimed_move_ms = 3LL * 24 * 3600 * 1000;
+
+// Starts a game between two existing players in a single statement, which
+// also checks that neither is already in an active game. Returns the new
+// game id, 0 if player2 doesn't exist or either player is busy, -1 on DB
+// error. A clock_ms of 0 makes an untimed game; `size` must be one of
+// kBoardSizes.
+static int create_game(sqlite3* db, const std::string& p1, const std::string& p2,
+                       int64_t clock_ms = 0, int64_t increment_ms = 0, int size = 8) {
+    static const std::map<int, std::string> start_boards = [] {
+        std::map<int, std::string> out;
+        for (int n : kBoardSizes) out[n] = board_to_json(initial_board(n));
+        return out;
+    }();
+    const std::string& board_json = start_boards.at(size);
+    const char* sql =
+        "INSERT INTO games(player1, player2, turn, pass_count, draw_offer_by, board, status, created_at, updated_at,"
+        " clock_ms, increment_ms, p1_ms, p2_ms, turn_started_ms)"
+        " SELECT ?1, ?2, 1, 0, NULL, ?3, 'active', ?4, ?4, ?5, ?6, ?5, ?5, ?7"
+        " WHERE EXISTS (SELECT 1 FROM users WHERE username=?2)"
+        // Two probes so each can use its partial index
+        " AND NOT EXISTS (SELECT 1 FROM games WHERE status='active' AND player1 IN (?1, ?2))"
+        " AND NOT EXISTS (SELECT 1 FROM games WHERE status='active' AND player2 IN (?1, ?2))"
+        " RETURNING id;";
+    sqlite3_stmt* ins = nullptr;
+    if (prepare(db, sql, &ins) != SQLITE_OK) return -1;
+    sqlite3_bind_text(ins, 1, p1.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(ins, 2, p2.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(ins, 3, board_json.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(ins, 4, (sqlite3_int64)std::time(nullptr));
+    if (clock_ms > 0) sqlite3_bind_int64(ins, 5, clock_ms);
+    else sqlite3_bind_null(ins, 5);
+    sqlite3_bind_int64(ins, 6, clock_ms > 0 ? increment_ms : 0);
+    sqlite3_bind_int64(ins, 7, MoveClock::nowMs());
+    int rc = sqlite3_step(ins);
+    int id = (rc == SQLITE_ROW) ? sqlite3_column_int(ins, 0) : (rc == SQLITE_DONE ? 0 : -1);
+    sqlite3_finalize(ins);
+    return id;
+}
+
+static bool in_active_game(sqlite3* db, const std::string& user) {
+    sqlite3_stmt* stmt = nullptr;
+    const char* sql =
+        "SELECT EXISTS (SELECT 1 FROM games WHERE status='active' AND player1=?1)"
+        " OR EXISTS (SELECT 1 FROM games WHERE status='active' AND player2=?1);";
+    if (prepare(db, sql, &stmt) != SQLITE_OK) return false;
+    sqlite3_bind_text(stmt, 1, user.c_str(), -1, SQLITE_TRANSIENT);
+    bool busy = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) != 0;
+    sqlite3_finalize(stmt);
+    return busy;
+}
+
+static int user_rating(sqlite3* db, const std::string& user) {
+    sqlite3_stmt* stmt = nullptr;
+    int rating = 1200;
+    if (prepare(db, "SELECT rating FROM users WHERE username=?;", &stmt) != SQLITE_OK) return rating;
+    sqlite3_bind_text(stmt, 1, user.c_str(), -1, SQLITE_TRANSIENT);
+    if (sqlite3_step(stmt) == SQLITE_ROW) rating = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    return rating;
+}
+
+// Messages between worker processes are fields joined by the ASCII unit
+// separator, which can't be typed into a username.
+static std::string join_fields(std::initializer_list<std::string> fields) {
+    std::string out;
+    for (const std::string& f : fields) {
+        if (!out.empty()) out += '\x1f';
+        out += f;
     }
     return out;
 }
 
+static std::vector<std::string> split_fields(const std::string& message) {
+    std::vector<std::string> out;
+    std::stringstream ss(message);
+    std::string field;
+    while (std::getline(ss, field, '\x1f')) out.push_back(field);
+    return out;
+}
+
+// The matchmaking queue: this process's own, or with WORKERS set the
+// supervisor's, so that players on different workers can be paired (see
+// matchmaking_request()). Remote calls block for the answer, so use this
+// from db_pool threads.
+struct MatchQueue {
+    Matchmaker* local = nullptr;
+    WorkerChannel* remote = nullptr;
+
+    std::optional<MatchPair> join(const std::string& user, int rating) {
+        if (local) return local->join(user, rating, Matchmaker::Clock::now());
+        auto f = split_fields(remote->call(join_fields({"join", user, std::to_string(rating)})).value_or(""));
+        if (f.size() == 3 && f[0] == "pair") return MatchPair{f[1], f[2]};
+        return std::nullopt;
+    }
+
+    bool leave(const std::string& user) {
+        if (local) return local->leave(user);
+        return remote->call(join_fields({"leave", user})).value_or("") == "1";
+    }
+
+    Matchmaker::Status status(const std::string& user) {
+        if (local) return local->status(user, Matchmaker::Clock::now());
+        Matchmaker::Status st;
+        auto f = split_fields(remote->call(join_fields({"status", user})).value_or(""));
+        if (f.size() != 4) return st;
+        st.state = (Matchmaker::Status::State)std::atoi(f[0].c_str());
+        st.game_id = std::atoi(f[1].c_str());
+        st.waited_s = std::atof(f[2].c_str());
+        st.window = std::atoi(f[3].c_str());
+        return st;
+    }
+
+    void recordMatch(const MatchPair& pair, int game_id) {
+        if (local) local->recordMatch(pair, game_id);
+        else remote->tell(join_fields({"matched", pair.player1, pair.player2, std::to_string(game_id)}));
+    }
+
+    void requeue(const std::string& user, int rating) {
+        if (local) local->requeue(user, rating, Matchmaker::Clock::now());
+        else remote->tell(join_fields({"requeue", user, std::to_string(rating)}));
+    }
+};
+
+// Serves a worker's MatchQueue request from the supervisor's queue.
+static std::string matchmaking_request(Matchmaker& mm, const std::string& request) {
+    auto f = split_fields(request);
+    auto now = Matchmaker::Clock::now();
+    if (f.size() == 3 && f[0] == "join") {
+        auto pair = mm.join(f[1], std::atoi(f[2].c_str()), now);
+        return pair ? join_fields({"pair", pair->player1, pair->player2}) : "queued";
+    }
+    if (f.size() == 2 && f[0] == "leave") return mm.leave(f[1]) ? "1" : "0";
+    if (f.size() == 2 && f[0] == "status") {
+        auto st = mm.status(f[1], now);
+        return join_fields({std::to_string((int)st.state), std::to_string(st.game_id),
+                            std::to_string(st.waited_s), std::to_string(st.window)});
+    }
+    if (f.size() == 4 && f[0] == "matched") mm.recordMatch({f[1], f[2]}, std::atoi(f[3].c_str()));
+    if (f.size() == 3 && f[0] == "requeue") mm.requeue(f[1], std::atoi(f[2].c_str()), now);
+    return "";
+}
+
+// Creates the game for a pair found by the matchmaker. If one player has
+// meanwhile started a game elsewhere, the other goes back in the queue.
+static void start_matched_game(sqlite3* db, MatchQueue& mm, GameTimers& timers, const MatchPair& pair) {
+    int game_id = create_game(db, pair.player1, pair.player2);
+    if (game_id > 0) {
+        timers.arm(game_id, untimed_move_ms);
+        mm.recordMatch(pair, game_id);
+        return;
+    }
+    for (const std::string& u : {pair.player1, pair.player2}) {
+        if (!in_active_game(db, u)) mm.requeue(u, user_rating(db, u));
+    }
+}
+
+// Position hashes are shown as 16 hex digits, as /api/positions takes them
+static std::string position_hex(uint64_t hash) {
+    char buf[17];
+    std::snprintf(buf, sizeof buf, "%016llx", (unsigned long long)hash);
+    return buf;
+}
+
+static int board_winner(const std::vector<std::vector<int>>& board) {
+    TraceSpan span("board.calcWinner");
+    int winner = 0;
+    with_board(board, [&](auto& game_board) { winner = game_board.calcWinner(); });
+    return winner;
+}
+
+// The winning side of an ended game as stored: timeouts and resignations
+// name the winner, games played out are decided by the board, and
+// anything else was a draw.
+static int stored_winner_side(const std::string& status, const std::string& winner, const std::string& p1,
+                              const std::string& p2, const std::vector<std::vector<int>>& board) {
+    if (status == "finished") return board_winner(board);
+    if (winner == p1) return 1;
+    if (winner == p2) return -1;
+    return 0;
+}
+
+// Game results are booked through a connection of their own, one at a
+// time: a transaction on the shared connection would take in whatever
+// other threads run on it meanwhile. Opened on first use.
+static std::mutex results_mtx;
+static sqlite3* results_db = nullptr;
+
+// Null if it can't be opened. Call with results_mtx held.
+static sqlite3* results_connection(sqlite3* db) {
+    if (results_db) return results_db;
+    if (sqlite3_open(sqlite3_db_filename(db, "main"), &results_db) != SQLITE_OK) {
+        sqlite3_close(results_db);
+        results_db = nullptr;
+        return nullptr;
+    }
+    sqlite3_trace_v2(results_db, SQLITE_TRACE_PROFILE, sqlite_profile, nullptr);
+    sqlite3_busy_timeout(results_db, 5000);
+    return results_db;
+}
+
+static void close_results_connection() {
+    std::lock_guard<std::mutex> lock(results_mtx);
+    if (results_db) sqlite3_close(results_db);
+    results_db = nullptr;
+}
+
+// Updates one player's rating and player_stats row; false on a DB error
+static bool book_side(sqlite3* db, const std::string& name, int side, int delta, int winner_side, int resigned_side,
+                      PlayerStats& stats) {
+    stats.username = name;
+    sqlite3_stmt* stmt = nullptr;
+    if (prepare(db, "UPDATE users SET rating=rating+? WHERE username=? RETURNING rating;", &stmt) != SQLITE_OK) return false;
+    sqlite3_bind_int(stmt, 1, delta);
+    sqlite3_bind_text(stmt, 2, name.c_str(), -1, SQLITE_TRANSIENT);
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) stats.rating = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE) return false;
+
+    const char* sql =
+        "INSERT INTO player_stats(username, wins, losses, draws, resignations) VALUES (?, ?, ?, ?, ?)"
+        " ON CONFLICT(username) DO UPDATE SET wins=wins+excluded.wins, losses=losses+excluded.losses,"
+        " draws=draws+excluded.draws, resignations=resignations+excluded.resignations"
+        " RETURNING wins, losses, draws, resignations;";
+    if (prepare(db, sql, &stmt) != SQLITE_OK) return false;
+    sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, 2, winner_side == side);
+    sqlite3_bind_int(stmt, 3, winner_side == -side);
+    sqlite3_bind_int(stmt, 4, winner_side == 0);
+    sqlite3_bind_int(stmt, 5, resigned_side == side);
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        stats.wins = sqlite3_column_int(stmt, 0);
+        stats.losses = sqlite3_column_int(stmt, 1);
+        stats.draws = sqlite3_column_int(stmt, 2);
+        stats.resignations = sqlite3_column_int(stmt, 3);
+    }
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_ROW;
+}
+
+// Books a game that has ended into both players' player_stats rows and
+// ratings, then the leaderboard and the position index. `winner_side` is
+// 1, -1 or 0 for a draw; `resigned_side` is the side that resigned, if
+// any. Call it after the UPDATE that ended the game succeeded. The game's
+// `booked` flag is set in the same transaction as the stats, so a game is
+// booked once however often this runs; one that never got booked is
+// picked up by book_pending_results() at the next start.
+static void record_result(sqlite3* db, int game_id, const std::string& p1, const std::string& p2, int winner_side, int resigned_side = 0) {
+    TraceSpan span("stats.record");
+    std::lock_guard<std::mutex> lock(results_mtx);
+    sqlite3* conn = results_connection(db);
+    if (!conn) {
+        std::cerr << "Failed to record the result of game " << game_id << ": no connection\n";
+        return;
+    }
+
+    if (!exec_sql(conn, "BEGIN IMMEDIATE;")) {
+        std::cerr << "Failed to record the result of game " << game_id << ": " << sqlite3_errmsg(conn) << "\n";
+        return;
+    }
+    sqlite3_stmt* claim = nullptr;
+    if (prepare(conn, "UPDATE games SET booked=1 WHERE id=? AND booked=0 AND status<>'active' RETURNING id;", &claim) != SQLITE_OK) {
+        exec_sql(conn, "ROLLBACK;");
+        return;
+    }
+    sqlite3_bind_int(claim, 1, game_id);
+    int claimed = sqlite3_step(claim);
+    sqlite3_finalize(claim);
+    if (claimed != SQLITE_ROW) {
+        // Already booked, or not over after all
+        exec_sql(conn, "ROLLBACK;");
+        return;
+    }
+    int r1 = user_rating(conn, p1);
+    int r2 = user_rating(conn, p2);
+    double score1 = winner_side == 1 ? 1.0 : (winner_side == 0 ? 0.5 : 0.0);
+    PlayerStats stats1, stats2;
+    bool ok = book_side(conn, p1, 1, elo_delta(r1, r2, score1), winner_side, resigned_side, stats1)
+           && book_side(conn, p2, -1, elo_delta(r2, r1, 1.0 - score1), winner_side, resigned_side, stats2);
+    if (!ok || !exec_sql(conn, "COMMIT;")) {
+        exec_sql(conn, "ROLLBACK;");
+        std::cerr << "Failed to record the result of game " << game_id << ": " << sqlite3_errmsg(conn) << "\n";
+        return;
+    }
+    leaderboard.update(stats1);
+    leaderboard.update(stats2);
+
+    sqlite3_stmt* stmt = nullptr;
+    if (prepare(conn, "SELECT board, moves FROM games WHERE id=?;", &stmt) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, game_id);
+        std::vector<LoggedMove> log;
+        // Games older than the move log would credit positions that
+        // never happened
+        if (sqlite3_step(stmt) == SQLITE_ROW
+            && parse_move_log((const char*)sqlite3_column_text(stmt, 1), log)) {
+            auto board = board_from_json((const char*)sqlite3_column_text(stmt, 0));
+            if (log_is_complete(board, log)) positions.recordResult((int)board.size(), log, winner_side);
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (peers) peers->broadcast(join_fields({"result", std::to_string(game_id)}));
+}
+
+// Books every game that ended without its result being booked, e.g.
+// because the server stopped in between.
+static void book_pending_results(sqlite3* db) {
+    struct Pending {
+        int id;
+        std::string p1, p2;
+        int winner_side, resigned_side;
+    };
+    std::vector<Pending> pending;
+    sqlite3_stmt* stmt = nullptr;
+    const char* sql = "SELECT id, player1, player2, status, winner, board FROM games WHERE booked=0 AND status<>'active';";
+    if (prepare(db, sql, &stmt) != SQLITE_OK) return;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        Pending p;
+        p.id = sqlite3_column_int(stmt, 0);
+        p.p1 = (const char*)sqlite3_column_text(stmt, 1);
+        p.p2 = (const char*)sqlite3_column_text(stmt, 2);
+        std::string status = (const char*)sqlite3_column_text(stmt, 3);
+        const unsigned char* winner_raw = sqlite3_column_text(stmt, 4);
+        auto board = board_from_json((const char*)sqlite3_column_text(stmt, 5));
+        p.winner_side = stored_winner_side(status, winner_raw ? (const char*)winner_raw : "", p.p1, p.p2, board);
+        p.resigned_side = status == "resigned" ? -p.winner_side : 0;
+        pending.push_back(p);
+    }
+    sqlite3_finalize(stmt);
+    for (const Pending& p : pending) record_result(db, p.id, p.p1, p.p2, p.winner_side, p.resigned_side);
+    if (!pending.empty()) std::cerr << "Booked " << pending.size() << " unbooked game result(s)\n";
+}
+
+// Reads username, rating, wins, losses, draws, resignations
+static PlayerStats read_player_stats(sqlite3_stmt* stmt) {
+    PlayerStats stats;
+    stats.username = (const char*)sqlite3_column_text(stmt, 0);
+    stats.rating = sqlite3_column_int(stmt, 1);
+    stats.wins = sqlite3_column_int(stmt, 2);
+    stats.losses = sqlite3_column_int(stmt, 3);
+    stats.draws = sqlite3_column_int(stmt, 4);
+    stats.resignations = sqlite3_column_int(stmt, 5);
+    return stats;
+}
+
+// Brings this process's leaderboard up to date with a result another
+// worker booked.
+static void reload_game_players(sqlite3* db, int game_id) {
+    sqlite3_stmt* stmt = nullptr;
+    const char* sql =
+        "SELECT s.username, u.rating, s.wins, s.losses, s.draws, s.resignations"
+        " FROM games g JOIN player_stats s ON s.username IN (g.player1, g.player2)"
+        " JOIN users u ON u.username=s.username WHERE g.id=?;";
+    if (prepare(db, sql, &stmt) != SQLITE_OK) return;
+    sqlite3_bind_int(stmt, 1, game_id);
+    while (sqlite3_step(stmt) == SQLITE_ROW) leaderboard.update(read_player_stats(stmt));
+    sqlite3_finalize(stmt);
+}
+
 static void add_winner_to_response(crow::json::wvalue& out, const std::vector<std::vector<int>>& board, const std::string& p1, const std::string& p2) {
-    Board game_board;
-    game_board.setBoard(board);
-    int winner_side = game_board.calcWinner();
+    int winner_side = board_winner(board);
     out["winner_side"] = winner_side;
     if (winner_side == 1) out["winner"] = p1;
     else if (winner_side == -1) out["winner"] = p2;
     else out["winner"] = "draw";
 }
 
-int main() {
-    crow::SimpleApp app;
+// Reads clock_ms, increment_ms, p1_ms, p2_ms, turn_started_ms, which
+// queries select in that order starting at column `col`.
+static MoveClock read_clock(sqlite3_stmt* stmt, int col) {
+    MoveClock clock;
+    clock.timed = sqlite3_column_type(stmt, col) != SQLITE_NULL;
+    clock.increment_ms = sqlite3_column_int64(stmt, col + 1);
+    clock.p1_ms = sqlite3_column_int64(stmt, col + 2);
+    clock.p2_ms = sqlite3_column_int64(stmt, col + 3);
+    clock.turn_started_ms = sqlite3_column_int64(stmt, col + 4);
+    return clock;
+}
+
+// Binds p1_ms, p2_ms, turn_started_ms starting at parameter `idx`.
+static void bind_clock(sqlite3_stmt* stmt, int idx, const MoveClock& clock) {
+    if (clock.timed) {
+        sqlite3_bind_int64(stmt, idx, clock.p1_ms);
+        sqlite3_bind_int64(stmt, idx + 1, clock.p2_ms);
+    } else {
+        sqlite3_bind_null(stmt, idx);
+        sqlite3_bind_null(stmt, idx + 1);
+    }
+    sqlite3_bind_int64(stmt, idx + 2, clock.turn_started_ms);
+}
+
+static void add_clock_to_response(crow::json::wvalue& out, const MoveClock& clock, int turn, bool active) {
+    int64_t now = MoveClock::nowMs();
+    out["clock"]["timed"] = clock.timed;
+    if (clock.timed) {
+        int64_t p1 = clock.p1_ms, p2 = clock.p2_ms;
+        if (active) {
+            int64_t left = clock.remaining(turn, now, untimed_move_ms);
+            (turn == 1 ? p1 : p2) = left > 0 ? left : 0;
+        }
+        out["clock"]["p1_ms"] = p1;
+        out["clock"]["p2_ms"] = p2;
+        out["clock"]["increment_ms"] = clock.increment_ms;
+    }
+    if (active) out["clock"]["move_deadline_ms"] = now + clock.remaining(turn, now, untimed_move_ms);
+}
+
+// The spectator view of a game, serialized: what /state shows, minus the
+// viewer's auto-pass. `revision` is set to the game's revision column.
+static std::optional<std::string> game_snapshot(sqlite3* db, int game_id, uint64_t& revision) {
+    TraceSpan span("spectator.snapshot");
+    sqlite3_stmt* stmt = nullptr;
+    const char* sql =
+        "SELECT player1, player2, turn, pass_count, draw_offer_by, board, status, winner,"
+        " clock_ms, increment_ms, p1_ms, p2_ms, turn_started_ms, takeback_by, revision FROM games WHERE id=?;";
+    if (prepare(db, sql, &stmt) != SQLITE_OK) return std::nullopt;
+    sqlite3_bind_int(stmt, 1, game_id);
+    if (sqlite3_step(stmt) != SQLITE_ROW) { sqlite3_finalize(stmt); return std::nullopt; }
+
+    std::string p1 = (const char*)sqlite3_column_text(stmt, 0);
+    std::string p2 = (const char*)sqlite3_column_text(stmt, 1);
+    int turn = sqlite3_column_int(stmt, 2);
+    const unsigned char* draw_raw = sqlite3_column_text(stmt, 4);
+    auto board = board_from_json((const char*)sqlite3_column_text(stmt, 5));
+    std::string status = (const char*)sqlite3_column_text(stmt, 6);
+    const unsigned char* winner_raw = sqlite3_column_text(stmt, 7);
+    revision = (uint64_t)sqlite3_column_int64(stmt, 14);
+
+    crow::json::wvalue out;
+    out["ok"] = true;
+    out["game_id"] = game_id;
+    out["player1"] = p1;
+    out["player2"] = p2;
+    out["turn"] = turn;
+    out["status"] = status;
+    out["pass_count"] = sqlite3_column_int(stmt, 3);
+    out["draw_offer_by"] = draw_raw ? (const char*)draw_raw : "";
+    const unsigned char* takeback_raw = sqlite3_column_text(stmt, 13);
+    out["takeback_by"] = takeback_raw ? (const char*)takeback_raw : "";
+    out["position_hash"] = position_hex(PositionIndex::hashBoard(board, turn));
+    if (status == "finished") {
+        add_winner_to_response(out, board, p1, p2);
+    } else if (winner_raw) {
+        out["winner"] = (const char*)winner_raw;
+    }
+    add_clock_to_response(out, read_clock(stmt, 8), turn, status == "active");
+    sqlite3_finalize(stmt);
+
+    out["board"] = crow::json::wvalue::list();
+    for (size_t r = 0; r < board.size(); r++) {
+        out["board"][r] = crow::json::wvalue::list();
+        for (size_t c = 0; c < board[r].size(); c++) {
+            out["board"][r][c] = board[r][c];
+        }
+    }
+    return out.dump();
+}
+
+// Only games someone is watching are re-read, once per change however
+// many spectators there are. Refreshes run concurrently, so one that read
+// an older revision may finish last; the hub drops it.
+static void refresh_spectators(sqlite3* db, int game_id) {
+    if (!spectators.watched(game_id)) return;
+    uint64_t revision = 0;
+    if (auto body = game_snapshot(db, game_id, revision)) spectators.publish(game_id, std::move(*body), revision);
+}
+
+// Call after any change to a game; other workers refresh their
+// spectators too.
+static void notify_spectators(sqlite3* db, int game_id) {
+    if (peers) peers->broadcast(join_fields({"game", std::to_string(game_id)}));
+    refresh_spectators(db, game_id);
+}
+
+static std::string position_report_line(size_t index, const PositionReport& report) {
+    crow::json::wvalue out;
+    out["index"] = (int)index;
+    out["ok"] = report.ok;
+    if (!report.ok) {
+        out["error"] = report.error;
+        return out.dump();
+    }
+    out["side"] = report.side;
+    out["moves"] = crow::json::wvalue::list();
+    for (size_t i = 0; i < report.moves.size(); i++) {
+        out["moves"][i] = PositionAnalyzer::squareName(report.moves[i].first, report.moves[i].second);
+    }
+    out["discs"]["x"] = report.discs_x;
+    out["discs"]["o"] = report.discs_o;
+    out["discs"]["empty"] = report.empty;
+    out["eval"] = report.eval;
+    if (report.depth > 0) {
+        out["search"]["depth"] = report.depth;
+        out["search"]["best"] = PositionAnalyzer::squareName(report.best_row, report.best_col);
+        out["search"]["score"] = report.score;
+        out["search"]["nodes"] = report.nodes;
+    }
+    return out.dump();
+}
+
+static crow::response snapshot_response(const SpectatorHub::Snapshot& snap) {
+    crow::response res(*snap.body);
+    res.set_header("Content-Type", "application/json");
+    res.set_header("X-Game-Version", std::to_string(snap.version));
+    return res;
+}
+
+// Ends the game as a loss on time for `side`, provided it is still active
+// and still the same turn. Returns false if a move or another ending got
+// there first.
+static bool finish_on_time(sqlite3* db, int game_id, int side, const MoveClock& clock, const std::string& p1, const std::string& p2) {
+    sqlite3_stmt* upd = nullptr;
+    // p1_ms*0 keeps an untimed game's NULL
+    const char* sql =
+        "UPDATE games SET revision=revision+1, status='timeout', winner=?, draw_offer_by=NULL,"
+        " p1_ms=CASE WHEN turn=1 THEN p1_ms*0 ELSE p1_ms END,"
+        " p2_ms=CASE WHEN turn=-1 THEN p2_ms*0 ELSE p2_ms END, updated_at=?"
+        " WHERE id=? AND status='active' AND turn=? AND turn_started_ms=? RETURNING id;";
+    if (prepare(db, sql, &upd) != SQLITE_OK) return false;
+    const std::string& winner = (side == 1) ? p2 : p1;
+    sqlite3_bind_text(upd, 1, winner.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(upd, 2, (sqlite3_int64)std::time(nullptr));
+    sqlite3_bind_int(upd, 3, game_id);
+    sqlite3_bind_int(upd, 4, side);
+    sqlite3_bind_int64(upd, 5, clock.turn_started_ms);
+    bool done = sqlite3_step(upd) == SQLITE_ROW;
+    sqlite3_finalize(upd);
+    if (done) {
+        record_result(db, game_id, p1, p2, -side);
+        notify_spectators(db, game_id);
+    }
+    return done;
+}
+
+// Writes the end of a turn: the new board (nullptr after a pass), whose
+// turn is next, the move log entry and both clocks, then re-arms or
+// clears the game's deadline. Only applies while the game is still active
+// on the turn that started at `turn_started_ms`, so a move cannot land on
+// a game that just ran out of time. Returns whether it was written.
+static bool commit_turn(sqlite3* db, GameTimers& timers, int game_id, int next_turn, int next_pass,
+                        const char* board_json, const std::string& token, const char* next_status,
+                        const MoveClock& clock, int64_t turn_started_ms) {
+    sqlite3_stmt* upd = nullptr;
+    const char* sql =
+        "UPDATE games SET revision=revision+1, turn=?, pass_count=?, draw_offer_by=NULL, takeback_by=NULL, board=COALESCE(?, board),"
+        " moves=moves||?, status=?, updated_at=?, p1_ms=?, p2_ms=?, turn_started_ms=?"
+        " WHERE id=? AND status='active' AND turn_started_ms=? RETURNING id;";
+    if (prepare(db, sql, &upd) != SQLITE_OK) return false;
+    sqlite3_bind_int(upd, 1, next_turn);
+    sqlite3_bind_int(upd, 2, next_pass);
+    if (board_json) sqlite3_bind_text(upd, 3, board_json, -1, SQLITE_TRANSIENT);
+    else sqlite3_bind_null(upd, 3);
+    sqlite3_bind_text(upd, 4, token.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(upd, 5, next_status, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(upd, 6, (sqlite3_int64)std::time(nullptr));
+    bind_clock(upd, 7, clock);
+    sqlite3_bind_int(upd, 10, game_id);
+    sqlite3_bind_int64(upd, 11, turn_started_ms);
+    bool done = sqlite3_step(upd) == SQLITE_ROW;
+    sqlite3_finalize(upd);
+    if (!done) return false;
+
+    if (std::string(next_status) == "active") {
+        timers.arm(game_id, clock.remaining(next_turn, clock.turn_started_ms, untimed_move_ms));
+    } else {
+        timers.disarm(game_id);
+    }
+    notify_spectators(db, game_id);
+    return true;
+}
+
+// Runs on a DB worker when a game's deadline passes. The player on move
+// may have moved since the timer was armed, in which case it is re-armed
+// for whatever they have left.
+static void check_clock(sqlite3* db, GameTimers& timers, int game_id) {
+    sqlite3_stmt* stmt = nullptr;
+    const char* sql =
+        "SELECT player1, player2, turn, status, clock_ms, increment_ms, p1_ms, p2_ms, turn_started_ms"
+        " FROM games WHERE id=?;";
+    if (prepare(db, sql, &stmt) != SQLITE_OK) return;
+    sqlite3_bind_int(stmt, 1, game_id);
+    if (sqlite3_step(stmt) != SQLITE_ROW) { sqlite3_finalize(stmt); return; }
+    std::string p1 = (const char*)sqlite3_column_text(stmt, 0);
+    std::string p2 = (const char*)sqlite3_column_text(stmt, 1);
+    int turn = sqlite3_column_int(stmt, 2);
+    std::string status = (const char*)sqlite3_column_text(stmt, 3);
+    MoveClock clock = read_clock(stmt, 4);
+    sqlite3_finalize(stmt);
+
+    if (status != "active") return;
+    int64_t left = clock.remaining(turn, MoveClock::nowMs(), untimed_move_ms);
+    if (left > 0) {
+        timers.arm(game_id, left);
+        return;
+    }
+    finish_on_time(db, game_id, turn, clock, p1, p2);
+}
+
+// Export spool files are left for Crow to stream and removed here once
+// they are a few minutes old. A download still in progress has the file
+// open, so removing it doesn't cut that download short.
+static void sweep_exports() {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    auto cutoff = fs::file_time_type::clock::now() - std::chrono::minutes(15);
+    for (const auto& entry : fs::directory_iterator("exports", ec)) {
+        if (entry.last_write_time(ec) < cutoff) fs::remove(entry.path(), ec);
+    }
+}
+
+static crow::json::wvalue backup_json(const DbMaintenance::BackupStatus& st, const std::string& path) {
+    using State = DbMaintenance::BackupStatus::State;
+    crow::json::wvalue out;
+    const char* names[] = {"idle", "running", "done", "failed"};
+    out["state"] = st.elsewhere ? "running" : names[(int)st.state];
+    if (st.elsewhere) out["elsewhere"] = true;
+    out["pages_done"] = st.pages_done;
+    out["pages_total"] = st.pages_total;
+    if (st.started_ms) out["started_ms"] = (long long)st.started_ms;
+    if (st.finished_ms) out["finished_ms"] = (long long)st.finished_ms;
+    if (st.state == State::Failed) out["error"] = st.error;
+    // Whichever process wrote it
+    out["path"] = path;
+    struct stat file;
+    if (stat(path.c_str(), &file) == 0) {
+        out["backup_bytes"] = (long long)file.st_size;
+        out["backup_mtime"] = (long long)file.st_mtime;
+    }
+    return out;
+}
+
+// Runs the whole server in this process. `channel_fd` links a prefork
+// worker to its supervisor, or is -1 when running alone; worker 0 is the
+// one that takes scheduled backups.
+static int serve(int channel_fd, int worker_index) {
+    crow::App<MetricsMiddleware, TraceMiddleware, CompressionMiddleware> app;
+
+    std::unique_ptr<WorkerChannel> channel;
+    if (channel_fd >= 0) {
+        channel = std::make_unique<WorkerChannel>(channel_fd);
+        peers = channel.get();
+        enable_reuse_port();
+    }
+
+    // Fraction of requests to trace, e.g. TRACE_SAMPLE_RATE=0.01
+    if (const char* rate = std::getenv("TRACE_SAMPLE_RATE")) Tracer::setSampleRate(std::atof(rate));
+    // Loopback clients may read /metrics and /debug/trace and force traces
+    app.get_middleware<TraceMiddleware>().trust_loopback = env_int("TRUST_LOOPBACK", 0) != 0;
+    // Smallest response body worth gzipping
+    app.get_middleware<CompressionMiddleware>().min_size = (size_t)std::max(0, env_int("GZIP_MIN_BYTES", 1024));
 
     sqlite3* db = nullptr;
     if (sqlite3_open("app.db", &db) != SQLITE_OK) {
         std::cerr << "Failed to open app.db\n";
         return 1;
     }
+    sqlite3_trace_v2(db, SQLITE_TRACE_PROFILE, sqlite_profile, nullptr);
+    // Bulk imports and other workers write through their own connections;
+    // WAL lets them read while one of them writes.
+    sqlite3_busy_timeout(db, 5000);
+    exec_sql(db, "PRAGMA journal_mode=WAL;");
     auto init = init_auth(db);
     if (!init.ok) {
         std::cerr << init.message << "\n";
@@ -109,7 +835,17 @@ int main() {
         " board TEXT NOT NULL,"
         " status TEXT NOT NULL,"
         " created_at INTEGER NOT NULL,"
-        " updated_at INTEGER NOT NULL"
+        " updated_at INTEGER NOT NULL,"
+        " clock_ms INTEGER,"
+        " increment_ms INTEGER NOT NULL DEFAULT 0,"
+        " p1_ms INTEGER,"
+        " p2_ms INTEGER,"
+        " turn_started_ms INTEGER,"
+        " winner TEXT,"
+        " moves TEXT NOT NULL DEFAULT '',"
+        " takeback_by TEXT,"
+        " revision INTEGER NOT NULL DEFAULT 0,"
+        " booked INTEGER NOT NULL DEFAULT 0"
         ");";
     if (!exec_sql(db, games_sql)) {
         std::cerr << "Failed to create games table\n";
@@ -117,6 +853,197 @@ int main() {
     }
     exec_sql(db, "ALTER TABLE games ADD COLUMN pass_count INTEGER NOT NULL DEFAULT 0;");
     exec_sql(db, "ALTER TABLE games ADD COLUMN draw_offer_by TEXT;");
+    exec_sql(db, "ALTER TABLE users ADD COLUMN rating INTEGER NOT NULL DEFAULT 1200;");
+    // Move clocks; a NULL clock_ms is an untimed game
+    exec_sql(db, "ALTER TABLE games ADD COLUMN clock_ms INTEGER;");
+    exec_sql(db, "ALTER TABLE games ADD COLUMN increment_ms INTEGER NOT NULL DEFAULT 0;");
+    exec_sql(db, "ALTER TABLE games ADD COLUMN p1_ms INTEGER;");
+    exec_sql(db, "ALTER TABLE games ADD COLUMN p2_ms INTEGER;");
+    exec_sql(db, "ALTER TABLE games ADD COLUMN turn_started_ms INTEGER;");
+    exec_sql(db, "ALTER TABLE games ADD COLUMN winner TEXT;");
+    // Move log for takebacks; see move_log_entry()
+    exec_sql(db, "ALTER TABLE games ADD COLUMN moves TEXT NOT NULL DEFAULT '';");
+    exec_sql(db, "ALTER TABLE games ADD COLUMN takeback_by TEXT;");
+    // Bumped by every UPDATE of a game, so spectator snapshots can be ordered
+    exec_sql(db, "ALTER TABLE games ADD COLUMN revision INTEGER NOT NULL DEFAULT 0;");
+    // Games that ended before results were flagged have been booked
+    if (exec_sql(db, "ALTER TABLE games ADD COLUMN booked INTEGER NOT NULL DEFAULT 0;")) {
+        exec_sql(db, "UPDATE games SET booked=1 WHERE status<>'active';");
+    }
+    exec_sql(db, "UPDATE games SET turn_started_ms=updated_at*1000 WHERE status='active' AND turn_started_ms IS NULL;");
+    const char* stats_sql =
+        "CREATE TABLE IF NOT EXISTS player_stats ("
+        " username TEXT PRIMARY KEY,"
+        " wins INTEGER NOT NULL DEFAULT 0,"
+        " losses INTEGER NOT NULL DEFAULT 0,"
+        " draws INTEGER NOT NULL DEFAULT 0,"
+        " resignations INTEGER NOT NULL DEFAULT 0"
+        ");";
+    if (!exec_sql(db, stats_sql)) {
+        std::cerr << "Failed to create player_stats table\n";
+        return 1;
+    }
+    {
+        sqlite3_stmt* stmt = nullptr;
+        const char* sql =
+            "SELECT s.username, u.rating, s.wins, s.losses, s.draws, s.resignations"
+            " FROM player_stats s JOIN users u ON u.username=s.username;";
+        if (prepare(db, sql, &stmt) == SQLITE_OK) {
+            while (sqlite3_step(stmt) == SQLITE_ROW) leaderboard.update(read_player_stats(stmt));
+            sqlite3_finalize(stmt);
+        }
+    }
+    {
+        // A new index file is filled from the games so far; from then on
+        // every move and result updates it as it happens.
+        const char* path = std::getenv("POSITION_INDEX");
+        bool created = false;
+        if (!positions.open(path && *path ? path : "positions.idx", created, peers != nullptr)) {
+            std::cerr << "Failed to open position index\n";
+            return 1;
+        }
+        sqlite3_stmt* stmt = nullptr;
+        if (created && prepare(db, "SELECT board, moves, status, winner, player1, player2, booked FROM games;", &stmt) == SQLITE_OK) {
+            std::vector<LoggedMove> log;
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                if (!parse_move_log((const char*)sqlite3_column_text(stmt, 1), log)) continue;
+                auto board = board_from_json((const char*)sqlite3_column_text(stmt, 0));
+                // Skip games whose log starts partway through or is missing
+                if (!log_is_complete(board, log)) continue;
+                positions.recordMoves((int)board.size(), log);
+                std::string status = (const char*)sqlite3_column_text(stmt, 2);
+                // Unbooked results are credited when they are booked below
+                if (status == "active" || !sqlite3_column_int(stmt, 6)) continue;
+                const unsigned char* winner_raw = sqlite3_column_text(stmt, 3);
+                int winner_side = stored_winner_side(status, winner_raw ? (const char*)winner_raw : "",
+                                                     (const char*)sqlite3_column_text(stmt, 4),
+                                                     (const char*)sqlite3_column_text(stmt, 5), board);
+                positions.recordResult((int)board.size(), log, winner_side);
+            }
+            sqlite3_finalize(stmt);
+        }
+    }
+    book_pending_results(db);
+    exec_sql(db, "CREATE INDEX IF NOT EXISTS games_active_player1 ON games(player1) WHERE status='active';");
+    exec_sql(db, "CREATE INDEX IF NOT EXISTS games_active_player2 ON games(player2) WHERE status='active';");
+
+    // Backups and WAL checkpoints, on their own thread and connection:
+    //   BACKUP_PATH         snapshot file (default backups/app.db)
+    //   BACKUP_EVERY_S      take one this often (default 0: only when asked)
+    //   CHECKPOINT_EVERY_S  WAL checkpoint interval (default 30)
+    DbMaintenance maintenance;
+    {
+        DbMaintenance::Options opts;
+        if (const char* path = std::getenv("BACKUP_PATH"); path && *path) opts.backup_path = path;
+        if (worker_index == 0) opts.backup_interval = std::chrono::seconds(std::max(0, env_int("BACKUP_EVERY_S", 0)));
+        opts.checkpoint_interval = std::chrono::seconds(std::max(1, env_int("CHECKPOINT_EVERY_S", 30)));
+        if (!maintenance.start(sqlite3_db_filename(db, "main"), opts)) {
+            std::cerr << "Failed to start database maintenance\n";
+            return 1;
+        }
+        // Checkpoint on the maintenance thread rather than in whichever
+        // request's commit crosses the threshold
+        sqlite3_wal_autocheckpoint(db, 0);
+    }
+
+    // Thread layout, all optional:
+    //   HTTP_THREADS  Crow I/O threads (default: one per core, split
+    //                 between the workers with WORKERS set)
+    //   DB_THREADS    workers for blocking SQLite/libsodium work (default 4)
+    //   DB_QUEUE      max queued blocking jobs before answering 503 (default 1024)
+    //   IO_CPUS, DB_CPUS, ANALYSIS_CPUS  CPU lists ("0-3,6") to pin each
+    //                 group to
+    unsigned cores = std::thread::hardware_concurrency();
+    int workers = std::max(1, env_int("WORKERS", 1));
+    int http_threads = env_int("HTTP_THREADS", cores ? std::max(1, (int)cores / (peers ? workers : 1)) : 2);
+    int db_threads = env_int("DB_THREADS", 4);
+    int db_queue = env_int("DB_QUEUE", 1024);
+    std::vector<int> io_cpus = parse_cpu_list(std::getenv("IO_CPUS") ? std::getenv("IO_CPUS") : "");
+    std::vector<int> db_cpus = parse_cpu_list(std::getenv("DB_CPUS") ? std::getenv("DB_CPUS") : "");
+    std::vector<int> analysis_cpus = parse_cpu_list(std::getenv("ANALYSIS_CPUS") ? std::getenv("ANALYSIS_CPUS") : "");
+
+    Executor db_pool(db_threads, (size_t)(db_queue > 0 ? db_queue : 1), db_cpus);
+    // CPU-bound position analysis gets its own pool so it can't starve DB work
+    int analysis_threads = env_int("ANALYSIS_THREADS", cores ? (int)cores : 2);
+    Executor analysis_pool(analysis_threads > 0 ? analysis_threads : 1, 4096, analysis_cpus);
+
+    int abandon_s = env_int("ABANDON_AFTER_S", 0);
+    if (abandon_s > 0) untimed_move_ms = abandon_s * 1000LL;
+
+    // Move deadlines for every active game. The expiry check touches the
+    // DB, so it runs on db_pool; if that is saturated, look again shortly.
+    TimingWheel wheel;
+    GameTimers timers(wheel, [&](int game_id) {
+        if (!db_pool.submit([&, game_id] { check_clock(db, timers, game_id); })) timers.arm(game_id, 1000);
+    });
+    // Drop spectator snapshots of games nobody has looked at for a while.
+    std::function<void()> evict_spectators = [&] {
+        spectators.evictIdle(std::chrono::minutes(10));
+        wheel.schedule(std::chrono::minutes(1), evict_spectators);
+    };
+    wheel.schedule(std::chrono::minutes(1), evict_spectators);
+    // Delete finished export spool files; off the wheel thread, which
+    // must not block on the filesystem.
+    std::function<void()> sweep_spool = [&] {
+        db_pool.submit(sweep_exports);
+        wheel.schedule(std::chrono::minutes(5), sweep_spool);
+    };
+    wheel.schedule(std::chrono::minutes(5), sweep_spool);
+    {
+        // Prefork workers split the games already running between them
+        // by id; each keeps re-arming its share until those games end. A
+        // restarted worker takes its share back. Games created or moved
+        // later are armed by whichever worker handled that request.
+        sqlite3_stmt* stmt = nullptr;
+        const char* sql =
+            "SELECT id, turn, clock_ms, increment_ms, p1_ms, p2_ms, turn_started_ms FROM games"
+            " WHERE status='active' AND id % ? = ?;";
+        if (prepare(db, sql, &stmt) == SQLITE_OK) {
+            sqlite3_bind_int(stmt, 1, channel ? workers : 1);
+            sqlite3_bind_int(stmt, 2, channel ? worker_index : 0);
+            int64_t now = MoveClock::nowMs();
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                MoveClock clock = read_clock(stmt, 2);
+                timers.arm(sqlite3_column_int(stmt, 0), clock.remaining(sqlite3_column_int(stmt, 1), now, untimed_move_ms));
+            }
+            sqlite3_finalize(stmt);
+        }
+    }
+
+    // Pairs players whose search windows have widened since they joined.
+    // Prefork workers share the supervisor's queue instead, which hands
+    // each pair its sweep finds to one of them.
+    Matchmaker own_matchmaker;
+    MatchQueue matchmaker{channel ? nullptr : &own_matchmaker, channel.get()};
+    std::atomic<bool> running{true};
+    std::thread matchmaking_thread;
+    if (!channel) {
+        matchmaking_thread = std::thread([&] {
+            while (running) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(250));
+                for (const MatchPair& pair : own_matchmaker.sweep(Matchmaker::Clock::now())) {
+                    start_matched_game(db, matchmaker, timers, pair);
+                }
+            }
+        });
+    } else {
+        channel->start([&](const std::string& message) {
+            auto f = split_fields(message);
+            if (f.size() == 2 && f[0] == "game") {
+                int game_id = std::atoi(f[1].c_str());
+                if (spectators.watched(game_id)) db_pool.submit([&, game_id] { refresh_spectators(db, game_id); });
+            } else if (f.size() == 2 && f[0] == "result") {
+                int game_id = std::atoi(f[1].c_str());
+                db_pool.submit([&, game_id] { reload_game_players(db, game_id); });
+            } else if (f.size() == 3 && f[0] == "match") {
+                MatchPair pair{f[1], f[2]};
+                // Too busy to start the game: hand the players back
+                if (!db_pool.submit([&, pair] { start_matched_game(db, matchmaker, timers, pair); })) {
+                    for (const std::string& u : {pair.player1, pair.player2}) matchmaker.requeue(u, user_rating(db, u));
+                }
+            }
+        });
+    }
 
     CROW_ROUTE(app, "/")([]{
         std::ifstream f("public/index.html"); // <-- assumes you run ./app from project root
@@ -135,6 +1062,40 @@ int main() {
     });
 
 
+    // Internal state is for admins, and for local scrapers without a
+    // session when TRUST_LOOPBACK=1.
+    auto internal_endpoint = [&](const crow::request& req, crow::response& res, std::function<crow::response()> render) {
+        if (app.get_middleware<TraceMiddleware>().trusted(req)) {
+            res = render();
+            res.end();
+            return;
+        }
+        offload(db_pool, res, [&, render]() -> crow::response {
+            auto user = require_user(db, req.get_header_value("Cookie"));
+            if (!user) return crow::response(401, "Login required");
+            if (!is_admin(*user)) return crow::response(403, "Admins only");
+            return render();
+        });
+    };
+
+    CROW_ROUTE(app, "/metrics")
+    ([&](const crow::request& req, crow::response& res){
+        internal_endpoint(req, res, [] {
+            crow::response out(Metrics::renderPrometheus());
+            out.set_header("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+            return out;
+        });
+    });
+
+    CROW_ROUTE(app, "/debug/trace")
+    ([&](const crow::request& req, crow::response& res){
+        internal_endpoint(req, res, [] {
+            crow::response out(Tracer::dumpChromeJson());
+            out.set_header("Content-Type", "application/json");
+            return out;
+        });
+    });
+
     CROW_ROUTE(app, "/api/hello")([]{
         crow::json::wvalue x;
         x["message"] = "Hello from C++";
@@ -143,19 +1104,15 @@ int main() {
 
     CROW_ROUTE(app, "/api/analyze").methods(crow::HTTPMethod::Post)
     ([](const crow::request& req){
-        auto body = crow::json::load(req.body);
-        if (!body || !body.has("text")) {
+        auto body = parse_json(req.body);
+        if (!has_string(body, "text")) {
             return crow::response(400, "Expected JSON: {\"text\":\"...\"}");
         }
 
         std::string text = body["text"].s();
 
         int n = (int)text.size();
-        int vowels = 0;
-        for (char c : text) {
-            char x = (char)std::tolower((unsigned char)c);
-            if (x=='a'||x=='e'||x=='i'||x=='o'||x=='u') vowels++;
-        }
+        int vowels = TextAnalyzer::countVowels(text);
 
         Submission s{ text, n, vowels, std::time(nullptr) };
 
@@ -168,38 +1125,296 @@ int main() {
         out["ok"] = true;
         out["length"] = n;
         out["vowels"] = vowels;
-        return crow::response(out);
+        return to_response(std::move(out));
     });
 
-    CROW_ROUTE(app, "/api/reverse").methods(crow::HTTPMethod::Post)
-    ([&](const crow::request& req){
+    // Accepts a JSON array of texts, {"texts":[...]}, or an NDJSON body
+    // (Content-Type: application/x-ndjson) with one text per line.
+    // Items may be strings or {"text":"..."} objects.
+    CROW_ROUTE(app, "/api/analyze/batch").methods(crow::HTTPMethod::Post)
+    ([](const crow::request& req){
+        const size_t max_items = 10000;
+
+        std::vector<std::string> texts;
+        std::vector<bool> valid;
+        auto take = [&](const crow::json::rvalue& item) {
+            if (item.t() == crow::json::type::String) {
+                texts.push_back(item.s());
+                valid.push_back(true);
+            } else if (item.t() == crow::json::type::Object && item.has("text")
+                       && item["text"].t() == crow::json::type::String) {
+                texts.push_back(item["text"].s());
+                valid.push_back(true);
+            } else {
+                texts.emplace_back();
+                valid.push_back(false);
+            }
+        };
+
+        std::string content_type = req.get_header_value("Content-Type");
+        if (content_type.find("ndjson") != std::string::npos) {
+            size_t pos = 0;
+            while (pos < req.body.size()) {
+                size_t end = req.body.find('\n', pos);
+                if (end == std::string::npos) end = req.body.size();
+                size_t len = end - pos;
+                if (len && req.body[end - 1] == '\r') len--;
+                if (len) {
+                    if (texts.size() >= max_items) return crow::response(413, "Too many items");
+                    auto line = crow::json::load(req.body.data() + pos, len);
+                    if (line) take(line);
+                    else { texts.emplace_back(); valid.push_back(false); }
+                }
+                pos = end + 1;
+            }
+        } else {
+            auto body = parse_json(req.body);
+            if (!body) return crow::response(400, "Expected JSON array of texts or NDJSON");
+            crow::json::rvalue list = body;
+            if (body.t() == crow::json::type::Object && body.has("texts")) list = body["texts"];
+            if (list.t() != crow::json::type::List) {
+                return crow::response(400, "Expected JSON: [\"...\", ...] or {\"texts\":[...]}");
+            }
+            if (list.size() > max_items) return crow::response(413, "Too many items");
+            for (size_t i = 0; i < list.size(); i++) take(list[i]);
+        }
 
-        auto user = require_user(db, req.get_header_value("Cookie"));
-        if (!user) return crow::response(401, "Login required");
+        crow::json::wvalue out;
+        out["ok"] = true;
+        out["count"] = (int)texts.size();
+        out["items"] = crow::json::wvalue::list();
 
-        auto body = crow::json::load(req.body);
-        if (!body || !body.has("numbers")) {
-            return crow::response(400, "Expected JSON: { \"numbers\": [1,2,3] }");
+        std::vector<Submission> batch;
+        batch.reserve(texts.size());
+        std::time_t now = std::time(nullptr);
+        for (size_t i = 0; i < texts.size(); i++) {
+            crow::json::wvalue item;
+            if (!valid[i]) {
+                item["ok"] = false;
+                item["error"] = "Expected a string or {\"text\":\"...\"}";
+                out["items"][i] = std::move(item);
+                continue;
+            }
+            int n = (int)texts[i].size();
+            int vowels = TextAnalyzer::countVowels(texts[i]);
+            item["ok"] = true;
+            item["length"] = n;
+            item["vowels"] = vowels;
+            out["items"][i] = std::move(item);
+            batch.push_back(Submission{ std::move(texts[i]), n, vowels, now });
         }
 
-        std::vector<int> nums;
-        for (size_t i = 0; i < body["numbers"].size(); i++) {
-            nums.push_back(body["numbers"][i].i());
+        { // lock scope
+            std::lock_guard<std::mutex> lock(submissions_mtx);
+            submissions.insert(submissions.end(),
+                               std::make_move_iterator(batch.begin()),
+                               std::make_move_iterator(batch.end()));
         }
 
-        // 🔥 call separate C++ logic
-        std::vector<int> reversed = NumberReverser::reverse(nums);
+        return to_response(std::move(out));
+    });
 
-        crow::json::wvalue res;
-        res["original"] = crow::json::wvalue::list();
-        res["reversed"] = crow::json::wvalue::list();
+    // Explorer for any position reached in a game, by the position_hash
+    // that game states carry: how often each move was played from it and
+    // how those games ended. Served from the in-memory index on the I/O
+    // thread.
+    CROW_ROUTE(app, "/api/positions/<string>").methods(crow::HTTPMethod::Get)
+    ([&](const std::string& hex){
+        uint64_t hash = 0;
+        auto parsed = std::from_chars(hex.data(), hex.data() + hex.size(), hash, 16);
+        if (hex.empty() || hex.size() > 16 || parsed.ec != std::errc() || parsed.ptr != hex.data() + hex.size()) {
+            return crow::response(400, "Expected a 16 digit hex position hash");
+        }
+        auto stats = positions.lookup(hash);
+        if (!stats.found) return crow::response(404, "Position not seen");
+
+        crow::json::wvalue out;
+        out["ok"] = true;
+        out["position_hash"] = position_hex(hash);
+        out["size"] = stats.size;
+        out["games"] = stats.x_wins + stats.o_wins + stats.draws;
+        out["x_wins"] = stats.x_wins;
+        out["o_wins"] = stats.o_wins;
+        out["draws"] = stats.draws;
+        out["moves"] = crow::json::wvalue::list();
+        for (size_t i = 0; i < stats.moves.size(); i++) {
+            const auto& m = stats.moves[i];
+            auto& entry = out["moves"][i];
+            if (m.square == PositionIndex::kPass) {
+                entry["move"] = "pass";
+            } else {
+                entry["row"] = m.square / stats.size;
+                entry["col"] = m.square % stats.size;
+                entry["move"] = PositionAnalyzer::squareName(m.square / stats.size, m.square % stats.size);
+            }
+            entry["count"] = m.count;
+        }
+        out["other_moves"] = stats.other_moves;
+        return to_response(std::move(out));
+    });
 
-        for (size_t i = 0; i < nums.size(); i++) {
-            res["original"][i] = nums[i];
-            res["reversed"][i] = reversed[i];
+    // Scores many positions at once:
+    //   {"positions":["<64 chars of X/O/->[X|O]", ...], "depth":0-4}
+    // The positions are split into chunks across analysis_pool and the
+    // answer is NDJSON, one line per position in input order, each tagged
+    // with its "index".
+    CROW_ROUTE(app, "/api/analyze-positions").methods(crow::HTTPMethod::Post)
+    ([&](const crow::request& req, crow::response& res){
+        const size_t max_items = 10000;
+
+        auto body = parse_json(req.body);
+        if (!body || body.t() != crow::json::type::Object || !body.has("positions")
+            || body["positions"].t() != crow::json::type::List) {
+            res = crow::response(400, "Expected JSON: {\"positions\":[\"...\"],\"depth\":0}");
+            res.end();
+            return;
+        }
+        if (body.has("depth") && !has_number(body, "depth")) {
+            res = crow::response(400, "depth must be a number");
+            res.end();
+            return;
+        }
+        int depth = body.has("depth") ? (int)body["depth"].i() : 0;
+        if (depth < 0 || depth > PositionAnalyzer::kMaxDepth) {
+            res = crow::response(400, "depth must be between 0 and " + std::to_string(PositionAnalyzer::kMaxDepth));
+            res.end();
+            return;
+        }
+        const auto& list = body["positions"];
+        if (list.size() > max_items) {
+            res = crow::response(413, "Too many positions");
+            res.end();
+            return;
         }
 
-        return crow::response(res);
+        struct Batch {
+            std::vector<std::string> positions;
+            std::vector<std::string> lines;
+            std::atomic<size_t> remaining{0};
+            std::atomic<bool> rejected{false};
+            std::atomic<bool> failed{false};
+        };
+        auto batch = std::make_shared<Batch>();
+        for (size_t i = 0; i < list.size(); i++) {
+            // Non-strings fail to decode and get an error line
+            batch->positions.push_back(list[i].t() == crow::json::type::String ? list[i].s() : std::string());
+        }
+        size_t n = batch->positions.size();
+        batch->lines.resize(n);
+
+        auto finish = [batch, &res] {
+            if (--batch->remaining != 0) return;
+            if (batch->rejected) {
+                res = crow::response(503, "Server busy");
+            } else if (batch->failed) {
+                res = crow::response(500, "Internal error");
+            } else {
+                TraceSpan span("analysis.join");
+                std::string out;
+                for (const std::string& line : batch->lines) {
+                    out += line;
+                    out += '\n';
+                }
+                res = crow::response(200, out);
+                res.set_header("Content-Type", "application/x-ndjson");
+            }
+            res.end();
+        };
+
+        // A few chunks per worker keeps them busy without a job per position
+        size_t chunk = n / ((size_t)analysis_threads * 4) + 1;
+        size_t chunks = (n + chunk - 1) / chunk;
+        if (chunks == 0) {
+            res = crow::response(200, "");
+            res.set_header("Content-Type", "application/x-ndjson");
+            res.end();
+            return;
+        }
+        batch->remaining = chunks;
+        uint64_t trace_id = Tracer::current();
+        for (size_t begin = 0; begin < n; begin += chunk) {
+            size_t end = std::min(n, begin + chunk);
+            bool queued = analysis_pool.submit([batch, finish, begin, end, depth, trace_id] {
+                Tracer::setCurrent(trace_id);
+                // The answer is already a 503 once any chunk was turned
+                // away; don't spend the CPU on the rest
+                if (batch->rejected) {
+                    finish();
+                    return;
+                }
+                // The last chunk to finish answers, so this one must
+                // count itself done however it ends
+                try {
+                    TraceSpan span("analysis.chunk");
+                    for (size_t i = begin; i < end; i++) {
+                        batch->lines[i] = position_report_line(i, PositionAnalyzer::analyze(batch->positions[i], depth));
+                    }
+                } catch (const std::exception& e) {
+                    std::cerr << "Analysis chunk failed: " << e.what() << "\n";
+                    batch->failed = true;
+                } catch (...) {
+                    batch->failed = true;
+                }
+                finish();
+            });
+            if (!queued) {
+                batch->rejected = true;
+                finish();
+            }
+        }
+    });
+
+    CROW_ROUTE(app, "/api/reverse").methods(crow::HTTPMethod::Post)
+    ([&](const crow::request& req, crow::response& res){
+        offload(db_pool, res, [&]() -> crow::response {
+
+            auto user = require_user(db, req.get_header_value("Cookie"));
+            if (!user) return crow::response(401, "Login required");
+
+            // Binary bodies are little-endian int32 and get a binary reply;
+            // JSON bodies are scanned for "numbers" without building a DOM.
+            // Either way the numbers are held in a single buffer and reversed
+            // in place.
+            std::vector<int> nums;
+            bool binary = req.get_header_value("Content-Type").find("application/octet-stream") != std::string::npos;
+            if (binary) {
+                if (!NumberReverser::fromLittleEndian(req.body, nums)) {
+                    return crow::response(400, "Expected little-endian int32 body (length must be a multiple of 4)");
+                }
+            } else if (!NumberReverser::parseJsonNumbers(req.body, nums)) {
+                return crow::response(400, "Expected JSON: { \"numbers\": [1,2,3] }");
+            }
+
+            // 🔥 call separate C++ logic
+            NumberReverser::reverseInPlace(nums);
+
+            crow::response reply;
+            if (binary) {
+                reply.set_header("Content-Type", "application/octet-stream");
+                reply.body = NumberReverser::toLittleEndian(nums);
+                return reply;
+            }
+
+            // The original order is the reversed buffer read backwards.
+            std::string& json = reply.body;
+            json.reserve(nums.size() * 24 + 32);
+            char buf[16];
+            json += "{\"original\":[";
+            for (size_t i = nums.size(); i-- > 0;) {
+                auto r = std::to_chars(buf, buf + sizeof(buf), nums[i]);
+                json.append(buf, r.ptr);
+                if (i) json += ',';
+            }
+            json += "],\"reversed\":[";
+            for (size_t i = 0; i < nums.size(); i++) {
+                if (i) json += ',';
+                auto r = std::to_chars(buf, buf + sizeof(buf), nums[i]);
+                json.append(buf, r.ptr);
+            }
+            json += "]}";
+            reply.set_header("Content-Type", "application/json");
+            return reply;
+        });
     });
 
     CROW_ROUTE(app, "/api/submissions").methods(crow::HTTPMethod::Get)
@@ -227,303 +1442,465 @@ int main() {
     });
 
     CROW_ROUTE(app, "/api/register").methods(crow::HTTPMethod::Post)
-    ([&](const crow::request& req){
-        auto body = crow::json::load(req.body);
-        if (!body || !body.has("username") || !body.has("password"))
-            return crow::response(400, "Expected {username,password}");
+    ([&](const crow::request& req, crow::response& res){
+        offload(db_pool, res, [&]() -> crow::response {
+            auto body = parse_json(req.body);
+            if (!has_string(body, "username") || !has_string(body, "password"))
+                return crow::response(400, "Expected {username,password}");
 
-        auto r = register_user(db, body["username"].s(), body["password"].s());
-        crow::json::wvalue out;
-        out["ok"] = r.ok;
-        out["message"] = r.message;
-        return crow::response(r.ok ? 200 : 400, out);
+            auto r = register_user(db, body["username"].s(), body["password"].s());
+            crow::json::wvalue out;
+            out["ok"] = r.ok;
+            out["message"] = r.message;
+            return to_response(std::move(out), r.ok ? 200 : 400);
+        });
     });
 
     CROW_ROUTE(app, "/api/login").methods(crow::HTTPMethod::Post)
-    ([&](const crow::request& req){
-        auto body = crow::json::load(req.body);
-        if (!body || !body.has("username") || !body.has("password"))
-            return crow::response(400, "Expected {username,password}");
+    ([&](const crow::request& req, crow::response& res){
+        offload(db_pool, res, [&]() -> crow::response {
+            auto body = parse_json(req.body);
+            if (!has_string(body, "username") || !has_string(body, "password"))
+                return crow::response(400, "Expected {username,password}");
 
-        auto sid = login_user(db, body["username"].s(), body["password"].s());
-        if (!sid) return crow::response(401, "Invalid credentials");
+            auto sid = login_user(db, body["username"].s(), body["password"].s());
+            if (!sid) return crow::response(401, "Invalid credentials");
 
-        crow::json::wvalue out;
-        out["ok"] = true;
+            crow::json::wvalue out;
+            out["ok"] = true;
 
-        crow::response res(out);
-        res.set_header("Set-Cookie", "sid=" + *sid + "; HttpOnly; Path=/; SameSite=Lax");
-        return res;
+            crow::response reply = to_response(std::move(out));
+            reply.set_header("Set-Cookie", "sid=" + *sid + "; HttpOnly; Path=/; SameSite=Lax");
+            return reply;
+        });
     });
 
     CROW_ROUTE(app, "/api/logout").methods(crow::HTTPMethod::Post)
-    ([&](const crow::request& req){
-        std::string cookie = req.get_header_value("Cookie");
-        logout_user(db, cookie);
+    ([&](const crow::request& req, crow::response& res){
+        offload(db_pool, res, [&]() -> crow::response {
+            std::string cookie = req.get_header_value("Cookie");
+            logout_user(db, cookie);
 
-        crow::json::wvalue out;
-        out["ok"] = true;
+            crow::json::wvalue out;
+            out["ok"] = true;
 
-        crow::response res(out);
-        res.set_header("Set-Cookie", "sid=; Max-Age=0; Path=/; SameSite=Lax");
-        return res;
+            crow::response reply = to_response(std::move(out));
+            reply.set_header("Set-Cookie", "sid=; Max-Age=0; Path=/; SameSite=Lax");
+            return reply;
+        });
     });
 
     CROW_ROUTE(app, "/api/me").methods(crow::HTTPMethod::Get)
-    ([&](const crow::request& req){
-        auto user = require_user(db, req.get_header_value("Cookie"));
-        if (!user) return crow::response(401, "Not logged in");
+    ([&](const crow::request& req, crow::response& res){
+        offload(db_pool, res, [&]() -> crow::response {
+            auto user = require_user(db, req.get_header_value("Cookie"));
+            if (!user) return crow::response(401, "Not logged in");
 
-        crow::json::wvalue out;
-        out["ok"] = true;
-        out["username"] = *user;
-        return crow::response(out);
+            crow::json::wvalue out;
+            out["ok"] = true;
+            out["username"] = *user;
+            return to_response(std::move(out));
+        });
     });
 
     CROW_ROUTE(app, "/api/games/create").methods(crow::HTTPMethod::Post)
-    ([&](const crow::request& req){
-        auto user = require_user(db, req.get_header_value("Cookie"));
-        if (!user) return crow::response(401, "Login required");
+    ([&](const crow::request& req, crow::response& res){
+        offload(db_pool, res, [&]() -> crow::response {
+            auto user = require_user(db, req.get_header_value("Cookie"));
+            if (!user) return crow::response(401, "Login required");
+
+            auto body = parse_json(req.body);
+            if (!has_string(body, "opponent")) {
+                return crow::response(400, "Expected JSON: {\"opponent\":\"username\"}");
+            }
 
-        auto body = crow::json::load(req.body);
-        if (!body || !body.has("opponent")) {
-            return crow::response(400, "Expected JSON: {\"opponent\":\"username\"}");
-        }
+            std::string opponent = body["opponent"].s();
+            if (opponent.empty()) return crow::response(400, "Opponent required");
+
+            // Optional time control, e.g. {"clock_s":300,"increment_s":2}
+            int64_t clock_ms = 0, increment_ms = 0;
+            if (body.has("clock_s")) {
+                if (!has_number(body, "clock_s")) return crow::response(400, "clock_s must be a number");
+                double clock_s = body["clock_s"].d();
+                if (clock_s < 10 || clock_s > 86400) return crow::response(400, "clock_s must be between 10 and 86400");
+                clock_ms = (int64_t)(clock_s * 1000);
+                if (body.has("increment_s")) {
+                    if (!has_number(body, "increment_s")) return crow::response(400, "increment_s must be a number");
+                    double increment_s = body["increment_s"].d();
+                    if (increment_s < 0 || increment_s > 600) return crow::response(400, "increment_s must be between 0 and 600");
+                    increment_ms = (int64_t)(increment_s * 1000);
+                }
+            }
 
-        std::string opponent = body["opponent"].s();
-        if (opponent.empty()) return crow::response(400, "Opponent required");
+            // Optional board size: 6, 8 (default) or 10
+            int size = 8;
+            if (body.has("size")) {
+                if (!has_number(body, "size")) return crow::response(400, "size must be a number");
+                size = (int)body["size"].i();
+                if (!is_board_size(size)) return crow::response(400, "size must be 6, 8 or 10");
+            }
 
-        sqlite3_stmt* chk = nullptr;
-        if (sqlite3_prepare_v2(db, "SELECT username FROM users WHERE username=?;", -1, &chk, nullptr) != SQLITE_OK) {
-            return crow::response(500, "DB error");
-        }
-        sqlite3_bind_text(chk, 1, opponent.c_str(), -1, SQLITE_TRANSIENT);
-        int rc = sqlite3_step(chk);
-        sqlite3_finalize(chk);
-        if (rc != SQLITE_ROW) return crow::response(404, "Opponent not found");
-
-        sqlite3_stmt* active = nullptr;
-        const char* active_sql =
-            "SELECT id FROM games WHERE status='active' AND (player1=? OR player2=? OR player1=? OR player2=?);";
-        if (sqlite3_prepare_v2(db, active_sql, -1, &active, nullptr) != SQLITE_OK) {
-            return crow::response(500, "DB error");
-        }
-        sqlite3_bind_text(active, 1, user->c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(active, 2, user->c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(active, 3, opponent.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(active, 4, opponent.c_str(), -1, SQLITE_TRANSIENT);
-        rc = sqlite3_step(active);
-        sqlite3_finalize(active);
-        if (rc == SQLITE_ROW) return crow::response(409, "Player already in active game");
-
-        std::string board_json = board_to_json(initial_board());
-        std::time_t now = std::time(nullptr);
+            int game_id = create_game(db, *user, opponent, clock_ms, increment_ms, size);
+            if (game_id < 0) return crow::response(500, "DB error");
+            if (game_id == 0) {
+                // Rare path: work out which check failed.
+                sqlite3_stmt* chk = nullptr;
+                if (prepare(db, "SELECT username FROM users WHERE username=?;", &chk) != SQLITE_OK) {
+                    return crow::response(500, "DB error");
+                }
+                sqlite3_bind_text(chk, 1, opponent.c_str(), -1, SQLITE_TRANSIENT);
+                int rc = sqlite3_step(chk);
+                sqlite3_finalize(chk);
+                if (rc != SQLITE_ROW) return crow::response(404, "Opponent not found");
+                return crow::response(409, "Player already in active game");
+            }
+            timers.arm(game_id, clock_ms > 0 ? clock_ms : untimed_move_ms);
 
-        sqlite3_stmt* ins = nullptr;
-        const char* ins_sql =
-            "INSERT INTO games(player1, player2, turn, pass_count, draw_offer_by, board, status, created_at, updated_at)"
-            " VALUES(?,?,?,?,?,?,?,?,?);";
-        if (sqlite3_prepare_v2(db, ins_sql, -1, &ins, nullptr) != SQLITE_OK) {
-            return crow::response(500, "DB error");
-        }
-        sqlite3_bind_text(ins, 1, user->c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(ins, 2, opponent.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int(ins, 3, 1);
-        sqlite3_bind_int(ins, 4, 0);
-        sqlite3_bind_null(ins, 5);
-        sqlite3_bind_text(ins, 6, board_json.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(ins, 7, "active", -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int64(ins, 8, (sqlite3_int64)now);
-        sqlite3_bind_int64(ins, 9, (sqlite3_int64)now);
-        rc = sqlite3_step(ins);
-        sqlite3_finalize(ins);
-        if (rc != SQLITE_DONE) return crow::response(500, "DB error");
+            crow::json::wvalue out;
+            out["ok"] = true;
+            out["game_id"] = game_id;
+            return to_response(std::move(out));
+        });
+    });
 
-        crow::json::wvalue out;
-        out["ok"] = true;
-        out["game_id"] = (int)sqlite3_last_insert_rowid(db);
-        return crow::response(out);
+    CROW_ROUTE(app, "/api/matchmaking/join").methods(crow::HTTPMethod::Post)
+    ([&](const crow::request& req, crow::response& res){
+        offload(db_pool, res, [&]() -> crow::response {
+            auto user = require_user(db, req.get_header_value("Cookie"));
+            if (!user) return crow::response(401, "Login required");
+            if (in_active_game(db, *user)) return crow::response(409, "Player already in active game");
+
+            int rating = user_rating(db, *user);
+            auto pair = matchmaker.join(*user, rating);
+            if (pair) start_matched_game(db, matchmaker, timers, *pair);
+
+            auto st = matchmaker.status(*user);
+            crow::json::wvalue out;
+            out["ok"] = true;
+            out["rating"] = rating;
+            out["status"] = st.state == Matchmaker::Status::Matched ? "matched" : "waiting";
+            if (st.state == Matchmaker::Status::Matched) out["game_id"] = st.game_id;
+            return to_response(std::move(out));
+        });
     });
 
-    CROW_ROUTE(app, "/api/games/<int>/state").methods(crow::HTTPMethod::Get)
-    ([&](const crow::request& req, int game_id){
-        auto viewer = require_user(db, req.get_header_value("Cookie"));
-        sqlite3_stmt* stmt = nullptr;
-        const char* sql = "SELECT player1, player2, turn, pass_count, draw_offer_by, board, status FROM games WHERE id=?;";
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            return crow::response(500, "DB error");
-        }
-        sqlite3_bind_int(stmt, 1, game_id);
-        int rc = sqlite3_step(stmt);
-        if (rc != SQLITE_ROW) { sqlite3_finalize(stmt); return crow::response(404, "Game not found"); }
-
-        std::string p1 = (const char*)sqlite3_column_text(stmt, 0);
-        std::string p2 = (const char*)sqlite3_column_text(stmt, 1);
-        int turn = sqlite3_column_int(stmt, 2);
-        int pass_count = sqlite3_column_int(stmt, 3);
-        const unsigned char* draw_raw = sqlite3_column_text(stmt, 4);
-        std::string draw_offer_by = draw_raw ? (const char*)draw_raw : "";
-        std::string board_json = (const char*)sqlite3_column_text(stmt, 5);
-        std::string status = (const char*)sqlite3_column_text(stmt, 6);
-        sqlite3_finalize(stmt);
+    CROW_ROUTE(app, "/api/matchmaking/status").methods(crow::HTTPMethod::Get)
+    ([&](const crow::request& req, crow::response& res){
+        offload(db_pool, res, [&]() -> crow::response {
+            auto user = require_user(db, req.get_header_value("Cookie"));
+            if (!user) return crow::response(401, "Login required");
 
-        auto board = board_from_json(board_json);
-
-        // Auto-pass if current player has no moves.
-        bool did_pass = false;
-        if (status == "active") {
-            bool can_autopass = false;
-            if (viewer && (*viewer == p1 || *viewer == p2)) {
-                int viewer_side = (*viewer == p1) ? 1 : -1;
-                if (viewer_side == turn) can_autopass = true;
-            }
-            if (can_autopass) {
-                Board game_board;
-                game_board.setBoard(board);
-                if (!game_board.anyMoves(turn)) {
-                int next_turn = (turn == 1) ? -1 : 1;
-                int next_pass = pass_count + 1;
-                const char* next_status = (next_pass >= 2) ? "finished" : "active";
+            auto st = matchmaker.status(*user);
+            crow::json::wvalue out;
+            out["ok"] = true;
+            if (st.state == Matchmaker::Status::Matched) {
+                out["status"] = "matched";
+                out["game_id"] = st.game_id;
+            } else if (st.state == Matchmaker::Status::Waiting) {
+                out["status"] = "waiting";
+                out["waited_s"] = st.waited_s;
+                out["window"] = st.window;
+            } else {
+                out["status"] = "idle";
+            }
+            return to_response(std::move(out));
+        });
+    });
 
-                sqlite3_stmt* upd = nullptr;
-                const char* upd_sql =
-                    "UPDATE games SET turn=?, pass_count=?, draw_offer_by=NULL, status=?, updated_at=? WHERE id=?;";
-                if (sqlite3_prepare_v2(db, upd_sql, -1, &upd, nullptr) == SQLITE_OK) {
-                    sqlite3_bind_int(upd, 1, next_turn);
-                    sqlite3_bind_int(upd, 2, next_pass);
-                    sqlite3_bind_text(upd, 3, next_status, -1, SQLITE_TRANSIENT);
-                    sqlite3_bind_int64(upd, 4, (sqlite3_int64)std::time(nullptr));
-                    sqlite3_bind_int(upd, 5, game_id);
-                    sqlite3_step(upd);
-                    sqlite3_finalize(upd);
+    CROW_ROUTE(app, "/api/matchmaking/leave").methods(crow::HTTPMethod::Post)
+    ([&](const crow::request& req, crow::response& res){
+        offload(db_pool, res, [&]() -> crow::response {
+            auto user = require_user(db, req.get_header_value("Cookie"));
+            if (!user) return crow::response(401, "Login required");
+
+            crow::json::wvalue out;
+            out["ok"] = true;
+            out["left"] = matchmaker.leave(*user);
+            return to_response(std::move(out));
+        });
+    });
+
+    CROW_ROUTE(app, "/api/games/<int>/state").methods(crow::HTTPMethod::Get)
+    ([&](const crow::request& req, crow::response& res, int game_id){
+        offload(db_pool, res, [&, game_id]() -> crow::response {
+            auto viewer = require_user(db, req.get_header_value("Cookie"));
+            sqlite3_stmt* stmt = nullptr;
+            const char* sql =
+                "SELECT player1, player2, turn, pass_count, draw_offer_by, board, status, winner,"
+                " clock_ms, increment_ms, p1_ms, p2_ms, turn_started_ms, takeback_by FROM games WHERE id=?;";
+            if (prepare(db, sql, &stmt) != SQLITE_OK) {
+                return crow::response(500, "DB error");
+            }
+            sqlite3_bind_int(stmt, 1, game_id);
+            int rc = sqlite3_step(stmt);
+            if (rc != SQLITE_ROW) { sqlite3_finalize(stmt); return crow::response(404, "Game not found"); }
+
+            std::string p1 = (const char*)sqlite3_column_text(stmt, 0);
+            std::string p2 = (const char*)sqlite3_column_text(stmt, 1);
+            int turn = sqlite3_column_int(stmt, 2);
+            int pass_count = sqlite3_column_int(stmt, 3);
+            const unsigned char* draw_raw = sqlite3_column_text(stmt, 4);
+            std::string draw_offer_by = draw_raw ? (const char*)draw_raw : "";
+            std::string board_json = (const char*)sqlite3_column_text(stmt, 5);
+            std::string status = (const char*)sqlite3_column_text(stmt, 6);
+            const unsigned char* winner_raw = sqlite3_column_text(stmt, 7);
+            std::string winner = winner_raw ? (const char*)winner_raw : "";
+            MoveClock clock = read_clock(stmt, 8);
+            const unsigned char* takeback_raw = sqlite3_column_text(stmt, 13);
+            std::string takeback_by = takeback_raw ? (const char*)takeback_raw : "";
+            sqlite3_finalize(stmt);
+
+            auto board = board_from_json(board_json);
+
+            // Auto-pass if current player has no moves.
+            bool did_pass = false;
+            if (status == "active") {
+                bool can_autopass = false;
+                if (viewer && (*viewer == p1 || *viewer == p2)) {
+                    int viewer_side = (*viewer == p1) ? 1 : -1;
+                    if (viewer_side == turn) can_autopass = true;
                 }
+                if (can_autopass) {
+                    bool has_moves = true;
+                    {
+                        TraceSpan span("board.anyMoves");
+                        with_board(board, [&](auto& game_board) { has_moves = game_board.anyMoves(turn); });
+                    }
+                    if (!has_moves) {
+                        MoveClock before = clock;
+                        if (!clock.endTurn(turn, MoveClock::nowMs(), untimed_move_ms)) {
+                            if (finish_on_time(db, game_id, turn, before, p1, p2)) {
+                                timers.disarm(game_id);
+                                winner = (turn == 1) ? p2 : p1;
+                                status = "timeout";
+                                draw_offer_by.clear();
+                            }
+                        } else {
+                            int next_turn = (turn == 1) ? -1 : 1;
+                            int next_pass = pass_count + 1;
+                            const char* next_status = (next_pass >= 2) ? "finished" : "active";
+                            if (commit_turn(db, timers, game_id, next_turn, next_pass, nullptr, move_log_entry(-1, 0), next_status, clock, before.turn_started_ms)) {
+                                positions.recordMove(PositionIndex::hashBoard(board, turn), (int)board.size(), PositionIndex::kPass);
+                                if (next_pass >= 2) record_result(db, game_id, p1, p2, board_winner(board));
+                                turn = next_turn;
+                                pass_count = next_pass;
+                                status = next_status;
+                                draw_offer_by.clear();
+                                takeback_by.clear();
+                                did_pass = true;
+                            } else {
+                                clock = before;
+                            }
+                        }
+                    }
+                }
+            }
 
-                turn = next_turn;
-                pass_count = next_pass;
-                status = next_status;
-                draw_offer_by.clear();
-                did_pass = true;
+            crow::json::wvalue out;
+            out["ok"] = true;
+            out["game_id"] = game_id;
+            out["player1"] = p1;
+            out["player2"] = p2;
+            out["turn"] = turn;
+            out["status"] = status;
+            out["pass_count"] = pass_count;
+            out["draw_offer_by"] = draw_offer_by;
+            out["takeback_by"] = takeback_by;
+            out["position_hash"] = position_hex(PositionIndex::hashBoard(board, turn));
+            if (did_pass) out["message"] = "No valid moves. Turn passed.";
+            if (status == "finished") {
+                add_winner_to_response(out, board, p1, p2);
+            } else if (!winner.empty()) {
+                out["winner"] = winner;
             }
+            add_clock_to_response(out, clock, turn, status == "active");
+            out["board"] = crow::json::wvalue::list();
+            for (size_t r = 0; r < board.size(); r++) {
+                out["board"][r] = crow::json::wvalue::list();
+                for (size_t c = 0; c < board[r].size(); c++) {
+                    out["board"][r][c] = board[r][c];
+                }
             }
-        }
+            return to_response(std::move(out));
+        });
+    });
 
-        crow::json::wvalue out;
-        out["ok"] = true;
-        out["game_id"] = game_id;
-        out["player1"] = p1;
-        out["player2"] = p2;
-        out["turn"] = turn;
-        out["status"] = status;
-        out["pass_count"] = pass_count;
-        out["draw_offer_by"] = draw_offer_by;
-        if (did_pass) out["message"] = "No valid moves. Turn passed.";
-        if (status == "finished") {
-            add_winner_to_response(out, board, p1, p2);
+    // Long-poll for spectators; no login needed. Answers as soon as the
+    // game is newer than `since` (the X-Game-Version of the previous
+    // answer), or after 25s with the state unchanged. Watchers of a game
+    // already in memory never touch the DB.
+    CROW_ROUTE(app, "/api/games/<int>/watch").methods(crow::HTTPMethod::Get)
+    ([&](const crow::request& req, crow::response& res, int game_id){
+        const char* since_raw = req.url_params.get("since");
+        uint64_t since = since_raw ? std::strtoull(since_raw, nullptr, 10) : 0;
+
+        auto snap = spectators.lookup(game_id);
+        if (!snap.body) {
+            offload(db_pool, res, [&, game_id]() -> crow::response {
+                uint64_t revision = 0;
+                auto body = game_snapshot(db, game_id, revision);
+                if (!body) {
+                    spectators.forget(game_id);
+                    return crow::response(404, "Game not found");
+                }
+                return snapshot_response(spectators.seed(game_id, std::move(*body), revision));
+            });
+            return;
         }
-        out["board"] = crow::json::wvalue::list();
-        for (size_t r = 0; r < board.size(); r++) {
-            out["board"][r] = crow::json::wvalue::list();
-            for (size_t c = 0; c < board[r].size(); c++) {
-                out["board"][r][c] = board[r][c];
-            }
+        uint64_t token = spectators.wait(game_id, since, [&res](const SpectatorHub::Snapshot& next) {
+            res = snapshot_response(next);
+            res.end();
+        });
+        if (token) {
+            wheel.schedule(std::chrono::seconds(25), [game_id, token] { spectators.expire(game_id, token); });
         }
-        return crow::response(out);
     });
 
     CROW_ROUTE(app, "/api/games/active").methods(crow::HTTPMethod::Get)
-    ([&](const crow::request& req){
-        auto user = require_user(db, req.get_header_value("Cookie"));
-        if (!user) return crow::response(401, "Login required");
-
-        sqlite3_stmt* stmt = nullptr;
-        const char* sql =
-            "SELECT id FROM games WHERE status='active' AND (player1=? OR player2=?) "
-            "ORDER BY updated_at DESC LIMIT 1;";
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            return crow::response(500, "DB error");
-        }
-        sqlite3_bind_text(stmt, 1, user->c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, user->c_str(), -1, SQLITE_TRANSIENT);
-        int rc = sqlite3_step(stmt);
-        if (rc != SQLITE_ROW) { sqlite3_finalize(stmt); return crow::response(404, "No active game"); }
+    ([&](const crow::request& req, crow::response& res){
+        offload(db_pool, res, [&]() -> crow::response {
+            auto user = require_user(db, req.get_header_value("Cookie"));
+            if (!user) return crow::response(401, "Login required");
+
+            sqlite3_stmt* stmt = nullptr;
+            const char* sql =
+                "SELECT id FROM games WHERE status='active' AND (player1=? OR player2=?) "
+                "ORDER BY updated_at DESC LIMIT 1;";
+            if (prepare(db, sql, &stmt) != SQLITE_OK) {
+                return crow::response(500, "DB error");
+            }
+            sqlite3_bind_text(stmt, 1, user->c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 2, user->c_str(), -1, SQLITE_TRANSIENT);
+            int rc = sqlite3_step(stmt);
+            if (rc != SQLITE_ROW) { sqlite3_finalize(stmt); return crow::response(404, "No active game"); }
 
-        int game_id = sqlite3_column_int(stmt, 0);
-        sqlite3_finalize(stmt);
+            int game_id = sqlite3_column_int(stmt, 0);
+            sqlite3_finalize(stmt);
 
-        crow::json::wvalue out;
-        out["ok"] = true;
-        out["game_id"] = game_id;
-        return crow::response(out);
+            crow::json::wvalue out;
+            out["ok"] = true;
+            out["game_id"] = game_id;
+            return to_response(std::move(out));
+        });
     });
 
     CROW_ROUTE(app, "/api/games/<int>/move").methods(crow::HTTPMethod::Post)
-    ([&](const crow::request& req, int game_id){
-        auto user = require_user(db, req.get_header_value("Cookie"));
-        if (!user) return crow::response(401, "Login required");
-
-        auto body = crow::json::load(req.body);
-        if (!body || !body.has("row") || !body.has("col")) {
-            return crow::response(400, "Expected JSON: {\"row\":0,\"col\":0}");
-        }
-        int row = body["row"].i();
-        int col = body["col"].i();
-
-        sqlite3_stmt* stmt = nullptr;
-        const char* sql = "SELECT player1, player2, turn, pass_count, draw_offer_by, board, status FROM games WHERE id=?;";
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            return crow::response(500, "DB error");
-        }
-        sqlite3_bind_int(stmt, 1, game_id);
-        int rc = sqlite3_step(stmt);
-        if (rc != SQLITE_ROW) { sqlite3_finalize(stmt); return crow::response(404, "Game not found"); }
-
-        std::string p1 = (const char*)sqlite3_column_text(stmt, 0);
-        std::string p2 = (const char*)sqlite3_column_text(stmt, 1);
-        int turn = sqlite3_column_int(stmt, 2);
-        int pass_count = sqlite3_column_int(stmt, 3);
-        const unsigned char* draw_raw = sqlite3_column_text(stmt, 4);
-        std::string draw_offer_by = draw_raw ? (const char*)draw_raw : "";
-        std::string board_json = (const char*)sqlite3_column_text(stmt, 5);
-        std::string status = (const char*)sqlite3_column_text(stmt, 6);
-        sqlite3_finalize(stmt);
-
-        if (status != "active") return crow::response(400, "Game not active");
+    ([&](const crow::request& req, crow::response& res, int game_id){
+        offload(db_pool, res, [&, game_id]() -> crow::response {
+            auto user = require_user(db, req.get_header_value("Cookie"));
+            if (!user) return crow::response(401, "Login required");
+
+            auto body = parse_json(req.body);
+            if (!has_number(body, "row") || !has_number(body, "col")) {
+                return crow::response(400, "Expected JSON: {\"row\":0,\"col\":0}");
+            }
+            int row = body["row"].i();
+            int col = body["col"].i();
+
+            sqlite3_stmt* stmt = nullptr;
+            const char* sql =
+                "SELECT player1, player2, turn, pass_count, draw_offer_by, board, status,"
+                " clock_ms, increment_ms, p1_ms, p2_ms, turn_started_ms FROM games WHERE id=?;";
+            if (prepare(db, sql, &stmt) != SQLITE_OK) {
+                return crow::response(500, "DB error");
+            }
+            sqlite3_bind_int(stmt, 1, game_id);
+            int rc = sqlite3_step(stmt);
+            if (rc != SQLITE_ROW) { sqlite3_finalize(stmt); return crow::response(404, "Game not found"); }
+
+            std::string p1 = (const char*)sqlite3_column_text(stmt, 0);
+            std::string p2 = (const char*)sqlite3_column_text(stmt, 1);
+            int turn = sqlite3_column_int(stmt, 2);
+            int pass_count = sqlite3_column_int(stmt, 3);
+            const unsigned char* draw_raw = sqlite3_column_text(stmt, 4);
+            std::string draw_offer_by = draw_raw ? (const char*)draw_raw : "";
+            std::string board_json = (const char*)sqlite3_column_text(stmt, 5);
+            std::string status = (const char*)sqlite3_column_text(stmt, 6);
+            MoveClock clock = read_clock(stmt, 7);
+            sqlite3_finalize(stmt);
+
+            if (status != "active") return crow::response(400, "Game not active");
+
+            int side = 0;
+            if (*user == p1) side = 1;
+            else if (*user == p2) side = -1;
+            else return crow::response(403, "Not a player in this game");
+
+            if (turn != side) return crow::response(409, "Not your turn");
+
+            // The deadline timer may not have fired yet; the clock decides.
+            const MoveClock before = clock;
+            if (!clock.endTurn(side, MoveClock::nowMs(), untimed_move_ms)) {
+                if (finish_on_time(db, game_id, side, before, p1, p2)) timers.disarm(game_id);
+                return crow::response(409, "Out of time");
+            }
 
-        std::time_t now = std::time(nullptr);
+            auto board = board_from_json(board_json);
+            int size = (int)board.size();
+            if (!is_board_size(size) || row < 0 || row >= size || col < 0 || col >= size) {
+                return crow::response(400, "Invalid move");
+            }
+            if (board[row][col] != 0) return crow::response(400, "Space occupied");
+
+            const uint64_t position = PositionIndex::hashBoard(board, side);
+            bool has_moves = true;
+            FlipMask flips = 0;
+            with_board(board, [&](auto& game_board) {
+                {
+                    TraceSpan span("board.anyMoves");
+                    has_moves = game_board.anyMoves(side);
+                }
+                if (!has_moves) return;
+                TraceSpan span("board.addPiece");
+                flips = game_board.addPiece(row, col, side);
+                if (flips) board = game_board.getBoard();
+            });
+            if (!has_moves) {
+                int next_turn = (side == 1) ? -1 : 1;
+                int next_pass = pass_count + 1;
+                const char* next_status = (next_pass >= 2) ? "finished" : "active";
 
-        int side = 0;
-        if (*user == p1) side = 1;
-        else if (*user == p2) side = -1;
-        else return crow::response(403, "Not a player in this game");
+                if (!commit_turn(db, timers, game_id, next_turn, next_pass, nullptr, move_log_entry(-1, 0), next_status, clock, before.turn_started_ms)) {
+                    return crow::response(409, "Game changed, reload");
+                }
+                positions.recordMove(position, size, PositionIndex::kPass);
+                if (next_pass >= 2) record_result(db, game_id, p1, p2, board_winner(board));
+
+                crow::json::wvalue out;
+                out["ok"] = true;
+                out["game_id"] = game_id;
+                out["turn"] = next_turn;
+                out["pass_count"] = next_pass;
+                out["status"] = next_status;
+                out["draw_offer_by"] = "";
+                out["message"] = "No valid moves. Turn passed.";
+                if (std::string(next_status) == "finished") {
+                    add_winner_to_response(out, board, p1, p2);
+                }
+                add_clock_to_response(out, clock, next_turn, next_pass < 2);
+                out["board"] = crow::json::wvalue::list();
+                for (size_t r = 0; r < board.size(); r++) {
+                    out["board"][r] = crow::json::wvalue::list();
+                    for (size_t c = 0; c < board[r].size(); c++) {
+                        out["board"][r][c] = board[r][c];
+                    }
+                }
+                return to_response(std::move(out));
+            }
 
-        if (turn != side) return crow::response(409, "Not your turn");
+            if (!flips) return crow::response(400, "Invalid move");
 
-        auto board = board_from_json(board_json);
-        if (board.size() != 8 || row < 0 || row > 7 || col < 0 || col > 7) {
-            return crow::response(400, "Invalid move");
-        }
-        if (board[row][col] != 0) return crow::response(400, "Space occupied");
+            int next_turn = (side == 1) ? -1 : 1;
 
-        Board game_board;
-        game_board.setBoard(board);
+            std::string new_json = board_to_json(board);
 
-        if (!game_board.anyMoves(side)) {
-            int next_turn = (side == 1) ? -1 : 1;
-            int next_pass = pass_count + 1;
+            int next_pass = 0;
             const char* next_status = (next_pass >= 2) ? "finished" : "active";
-
-            sqlite3_stmt* upd = nullptr;
-            const char* upd_sql = "UPDATE games SET turn=?, pass_count=?, draw_offer_by=NULL, status=?, updated_at=? WHERE id=?;";
-            if (sqlite3_prepare_v2(db, upd_sql, -1, &upd, nullptr) != SQLITE_OK) {
-                return crow::response(500, "DB error");
+            if (!commit_turn(db, timers, game_id, next_turn, next_pass, new_json.c_str(), move_log_entry(row * size + col, flips), next_status,
+                             clock, before.turn_started_ms)) {
+                return crow::response(409, "Game changed, reload");
             }
-            sqlite3_bind_int(upd, 1, next_turn);
-            sqlite3_bind_int(upd, 2, next_pass);
-            sqlite3_bind_text(upd, 3, next_status, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int64(upd, 4, (sqlite3_int64)now);
-            sqlite3_bind_int(upd, 5, game_id);
-            sqlite3_step(upd);
-            sqlite3_finalize(upd);
+            positions.recordMove(position, size, row * size + col);
 
             crow::json::wvalue out;
             out["ok"] = true;
@@ -532,10 +1909,8 @@ int main() {
             out["pass_count"] = next_pass;
             out["status"] = next_status;
             out["draw_offer_by"] = "";
-            out["message"] = "No valid moves. Turn passed.";
-            if (std::string(next_status) == "finished") {
-                add_winner_to_response(out, board, p1, p2);
-            }
+            out["position_hash"] = position_hex(PositionIndex::applyMove(position, row * size + col, flips, side));
+            add_clock_to_response(out, clock, next_turn, true);
             out["board"] = crow::json::wvalue::list();
             for (size_t r = 0; r < board.size(); r++) {
                 out["board"][r] = crow::json::wvalue::list();
@@ -543,172 +1918,502 @@ int main() {
                     out["board"][r][c] = board[r][c];
                 }
             }
-            return crow::response(out);
-        }
+            return to_response(std::move(out));
+        });
+    });
 
-        bool ok = game_board.addPiece(row, col, side);
-        if (!ok) return crow::response(400, "Invalid move");
+    CROW_ROUTE(app, "/api/games/<int>/resign").methods(crow::HTTPMethod::Post)
+    ([&](const crow::request& req, crow::response& res, int game_id){
+        offload(db_pool, res, [&, game_id]() -> crow::response {
+            auto user = require_user(db, req.get_header_value("Cookie"));
+            if (!user) return crow::response(401, "Login required");
+
+            sqlite3_stmt* stmt = nullptr;
+            const char* sql = "SELECT player1, player2, status FROM games WHERE id=?;";
+            if (prepare(db, sql, &stmt) != SQLITE_OK) {
+                return crow::response(500, "DB error");
+            }
+            sqlite3_bind_int(stmt, 1, game_id);
+            int rc = sqlite3_step(stmt);
+            if (rc != SQLITE_ROW) { sqlite3_finalize(stmt); return crow::response(404, "Game not found"); }
 
-        board = game_board.getBoard();
-        int next_turn = (side == 1) ? -1 : 1;
+            std::string p1 = (const char*)sqlite3_column_text(stmt, 0);
+            std::string p2 = (const char*)sqlite3_column_text(stmt, 1);
+            std::string status = (const char*)sqlite3_column_text(stmt, 2);
+            sqlite3_finalize(stmt);
 
-        std::string new_json = board_to_json(board);
+            if (status != "active") return crow::response(400, "Game not active");
+            if (*user != p1 && *user != p2) return crow::response(403, "Not a player in this game");
 
-        sqlite3_stmt* upd = nullptr;
-        const char* upd_sql = "UPDATE games SET turn=?, pass_count=?, draw_offer_by=NULL, board=?, status=?, updated_at=? WHERE id=?;";
-        if (sqlite3_prepare_v2(db, upd_sql, -1, &upd, nullptr) != SQLITE_OK) {
-            return crow::response(500, "DB error");
-        }
-        int next_pass = 0;
-        const char* next_status = (next_pass >= 2) ? "finished" : "active";
-        sqlite3_bind_int(upd, 1, next_turn);
-        sqlite3_bind_int(upd, 2, next_pass);
-        sqlite3_bind_text(upd, 3, new_json.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(upd, 4, next_status, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int64(upd, 5, (sqlite3_int64)now);
-        sqlite3_bind_int(upd, 6, game_id);
-        sqlite3_step(upd);
-        sqlite3_finalize(upd);
+            std::string winner = (*user == p1) ? p2 : p1;
 
-        crow::json::wvalue out;
-        out["ok"] = true;
-        out["game_id"] = game_id;
-        out["turn"] = next_turn;
-        out["pass_count"] = next_pass;
-        out["status"] = next_status;
-        out["draw_offer_by"] = "";
-        out["board"] = crow::json::wvalue::list();
-        for (size_t r = 0; r < board.size(); r++) {
-            out["board"][r] = crow::json::wvalue::list();
-            for (size_t c = 0; c < board[r].size(); c++) {
-                out["board"][r][c] = board[r][c];
+            sqlite3_stmt* upd = nullptr;
+            const char* upd_sql =
+                "UPDATE games SET revision=revision+1, status='resigned', winner=?, draw_offer_by=NULL, updated_at=?"
+                " WHERE id=? AND status='active' RETURNING id;";
+            if (prepare(db, upd_sql, &upd) != SQLITE_OK) {
+                return crow::response(500, "DB error");
             }
-        }
-        return crow::response(out);
+            sqlite3_bind_text(upd, 1, winner.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int64(upd, 2, (sqlite3_int64)std::time(nullptr));
+            sqlite3_bind_int(upd, 3, game_id);
+            bool ended = sqlite3_step(upd) == SQLITE_ROW;
+            sqlite3_finalize(upd);
+            if (!ended) return crow::response(400, "Game not active");
+            timers.disarm(game_id);
+            int resigned_side = (*user == p1) ? 1 : -1;
+            record_result(db, game_id, p1, p2, -resigned_side, resigned_side);
+            notify_spectators(db, game_id);
+
+            crow::json::wvalue out;
+            out["ok"] = true;
+            out["status"] = "resigned";
+            out["winner"] = winner;
+            return to_response(std::move(out));
+        });
     });
 
-    CROW_ROUTE(app, "/api/games/<int>/resign").methods(crow::HTTPMethod::Post)
-    ([&](const crow::request& req, int game_id){
-        auto user = require_user(db, req.get_header_value("Cookie"));
-        if (!user) return crow::response(401, "Login required");
+    CROW_ROUTE(app, "/api/games/<int>/offer-draw").methods(crow::HTTPMethod::Post)
+    ([&](const crow::request& req, crow::response& res, int game_id){
+        offload(db_pool, res, [&, game_id]() -> crow::response {
+            auto user = require_user(db, req.get_header_value("Cookie"));
+            if (!user) return crow::response(401, "Login required");
+
+            sqlite3_stmt* stmt = nullptr;
+            const char* sql = "SELECT player1, player2, status FROM games WHERE id=?;";
+            if (prepare(db, sql, &stmt) != SQLITE_OK) {
+                return crow::response(500, "DB error");
+            }
+            sqlite3_bind_int(stmt, 1, game_id);
+            int rc = sqlite3_step(stmt);
+            if (rc != SQLITE_ROW) { sqlite3_finalize(stmt); return crow::response(404, "Game not found"); }
 
-        sqlite3_stmt* stmt = nullptr;
-        const char* sql = "SELECT player1, player2, status FROM games WHERE id=?;";
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            return crow::response(500, "DB error");
-        }
-        sqlite3_bind_int(stmt, 1, game_id);
-        int rc = sqlite3_step(stmt);
-        if (rc != SQLITE_ROW) { sqlite3_finalize(stmt); return crow::response(404, "Game not found"); }
+            std::string p1 = (const char*)sqlite3_column_text(stmt, 0);
+            std::string p2 = (const char*)sqlite3_column_text(stmt, 1);
+            std::string status = (const char*)sqlite3_column_text(stmt, 2);
+            sqlite3_finalize(stmt);
 
-        std::string p1 = (const char*)sqlite3_column_text(stmt, 0);
-        std::string p2 = (const char*)sqlite3_column_text(stmt, 1);
-        std::string status = (const char*)sqlite3_column_text(stmt, 2);
-        sqlite3_finalize(stmt);
+            if (status != "active") return crow::response(400, "Game not active");
+            if (*user != p1 && *user != p2) return crow::response(403, "Not a player in this game");
 
-        if (status != "active") return crow::response(400, "Game not active");
-        if (*user != p1 && *user != p2) return crow::response(403, "Not a player in this game");
+            sqlite3_stmt* upd = nullptr;
+            const char* upd_sql = "UPDATE games SET revision=revision+1, draw_offer_by=?, updated_at=? WHERE id=?;";
+            if (prepare(db, upd_sql, &upd) != SQLITE_OK) {
+                return crow::response(500, "DB error");
+            }
+            sqlite3_bind_text(upd, 1, user->c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int64(upd, 2, (sqlite3_int64)std::time(nullptr));
+            sqlite3_bind_int(upd, 3, game_id);
+            sqlite3_step(upd);
+            sqlite3_finalize(upd);
+            notify_spectators(db, game_id);
 
-        std::string winner = (*user == p1) ? p2 : p1;
+            crow::json::wvalue out;
+            out["ok"] = true;
+            out["status"] = "active";
+            out["draw_offer_by"] = *user;
+            return to_response(std::move(out));
+        });
+    });
 
-        sqlite3_stmt* upd = nullptr;
-        const char* upd_sql = "UPDATE games SET status='resigned', draw_offer_by=NULL, updated_at=? WHERE id=?;";
-        if (sqlite3_prepare_v2(db, upd_sql, -1, &upd, nullptr) != SQLITE_OK) {
-            return crow::response(500, "DB error");
-        }
-        sqlite3_bind_int64(upd, 1, (sqlite3_int64)std::time(nullptr));
-        sqlite3_bind_int(upd, 2, game_id);
-        sqlite3_step(upd);
-        sqlite3_finalize(upd);
+    CROW_ROUTE(app, "/api/games/<int>/accept-draw").methods(crow::HTTPMethod::Post)
+    ([&](const crow::request& req, crow::response& res, int game_id){
+        offload(db_pool, res, [&, game_id]() -> crow::response {
+            auto user = require_user(db, req.get_header_value("Cookie"));
+            if (!user) return crow::response(401, "Login required");
+
+            sqlite3_stmt* stmt = nullptr;
+            const char* sql = "SELECT player1, player2, status, draw_offer_by FROM games WHERE id=?;";
+            if (prepare(db, sql, &stmt) != SQLITE_OK) {
+                return crow::response(500, "DB error");
+            }
+            sqlite3_bind_int(stmt, 1, game_id);
+            int rc = sqlite3_step(stmt);
+            if (rc != SQLITE_ROW) { sqlite3_finalize(stmt); return crow::response(404, "Game not found"); }
+
+            std::string p1 = (const char*)sqlite3_column_text(stmt, 0);
+            std::string p2 = (const char*)sqlite3_column_text(stmt, 1);
+            std::string status = (const char*)sqlite3_column_text(stmt, 2);
+            const unsigned char* draw_raw = sqlite3_column_text(stmt, 3);
+            std::string draw_offer_by = draw_raw ? (const char*)draw_raw : "";
+            sqlite3_finalize(stmt);
+
+            if (status != "active") return crow::response(400, "Game not active");
+            if (*user != p1 && *user != p2) return crow::response(403, "Not a player in this game");
+            if (draw_offer_by.empty()) return crow::response(409, "No draw offer");
+            if (draw_offer_by == *user) return crow::response(409, "You cannot accept your own offer");
 
-        crow::json::wvalue out;
-        out["ok"] = true;
-        out["status"] = "resigned";
-        out["winner"] = winner;
-        return crow::response(out);
-    });
+            sqlite3_stmt* upd = nullptr;
+            const char* upd_sql =
+                "UPDATE games SET revision=revision+1, status='draw', draw_offer_by=NULL, updated_at=?"
+                " WHERE id=? AND status='active' AND draw_offer_by IS NOT NULL RETURNING id;";
+            if (prepare(db, upd_sql, &upd) != SQLITE_OK) {
+                return crow::response(500, "DB error");
+            }
+            sqlite3_bind_int64(upd, 1, (sqlite3_int64)std::time(nullptr));
+            sqlite3_bind_int(upd, 2, game_id);
+            bool ended = sqlite3_step(upd) == SQLITE_ROW;
+            sqlite3_finalize(upd);
+            if (!ended) return crow::response(409, "No draw offer");
+            timers.disarm(game_id);
+            record_result(db, game_id, p1, p2, 0);
+            notify_spectators(db, game_id);
 
-    CROW_ROUTE(app, "/api/games/<int>/offer-draw").methods(crow::HTTPMethod::Post)
-    ([&](const crow::request& req, int game_id){
-        auto user = require_user(db, req.get_header_value("Cookie"));
-        if (!user) return crow::response(401, "Login required");
+            crow::json::wvalue out;
+            out["ok"] = true;
+            out["status"] = "draw";
+            return to_response(std::move(out));
+        });
+    });
 
-        sqlite3_stmt* stmt = nullptr;
-        const char* sql = "SELECT player1, player2, status FROM games WHERE id=?;";
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            return crow::response(500, "DB error");
-        }
-        sqlite3_bind_int(stmt, 1, game_id);
-        int rc = sqlite3_step(stmt);
-        if (rc != SQLITE_ROW) { sqlite3_finalize(stmt); return crow::response(404, "Game not found"); }
+    // Every ended game, as NDJSON (default) or ?format=binary; see
+    // GameArchive. The export is spooled to disk through a cursor and Crow
+    // streams the file back in chunks, so neither side holds the archive
+    // in memory.
+    CROW_ROUTE(app, "/api/games/export").methods(crow::HTTPMethod::Get)
+    ([&](const crow::request& req, crow::response& res){
+        offload(db_pool, res, [&]() -> crow::response {
+            auto user = require_user(db, req.get_header_value("Cookie"));
+            if (!user) return crow::response(401, "Login required");
+            if (!is_admin(*user)) return crow::response(403, "Admins only");
+
+            const char* fmt = req.url_params.get("format");
+            bool binary = fmt && std::string(fmt) == "binary";
+            if (fmt && !binary && std::string(fmt) != "ndjson") return crow::response(400, "format must be ndjson or binary");
+
+            std::error_code ec;
+            std::filesystem::create_directories("exports", ec);
+            static std::atomic<unsigned> export_seq{0};
+            std::string path = "exports/games-" + std::to_string(std::time(nullptr)) + "-"
+                             + std::to_string(export_seq++) + (binary ? ".bin" : ".ndjson");
+            sqlite3* export_db = nullptr;
+            if (sqlite3_open_v2(sqlite3_db_filename(db, "main"), &export_db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+                sqlite3_close(export_db);
+                return crow::response(500, "DB error");
+            }
+            long long count = GameArchive::exportTo(export_db, path, binary ? GameArchive::Format::Binary : GameArchive::Format::Ndjson);
+            sqlite3_close(export_db);
+            if (count < 0) return crow::response(500, "Export failed");
+
+            crow::response reply;
+            reply.set_static_file_info_unsafe(path);
+            reply.set_header("Content-Type", binary ? "application/octet-stream" : "application/x-ndjson");
+            reply.set_header("Content-Disposition", std::string("attachment; filename=\"games.") + (binary ? "bin" : "ndjson") + "\"");
+            reply.set_header("X-Game-Count", std::to_string(count));
+            return reply;
+        });
+    });
 
-        std::string p1 = (const char*)sqlite3_column_text(stmt, 0);
-        std::string p2 = (const char*)sqlite3_column_text(stmt, 1);
-        std::string status = (const char*)sqlite3_column_text(stmt, 2);
-        sqlite3_finalize(stmt);
+    // Loads an export (NDJSON, or binary with Content-Type:
+    // application/octet-stream) as new games, committing every 1000.
+    CROW_ROUTE(app, "/api/games/import").methods(crow::HTTPMethod::Post)
+    ([&](const crow::request& req, crow::response& res){
+        offload(db_pool, res, [&]() -> crow::response {
+            auto user = require_user(db, req.get_header_value("Cookie"));
+            if (!user) return crow::response(401, "Login required");
+            if (!is_admin(*user)) return crow::response(403, "Admins only");
+
+            bool binary = req.get_header_value("Content-Type").find("octet-stream") != std::string::npos;
+
+            // The shared connection can't hold a transaction for one thread.
+            sqlite3* import_db = nullptr;
+            if (sqlite3_open(sqlite3_db_filename(db, "main"), &import_db) != SQLITE_OK) {
+                sqlite3_close(import_db);
+                return crow::response(500, "DB error");
+            }
+            sqlite3_busy_timeout(import_db, 5000);
+            auto result = GameArchive::importFrom(import_db, req.body,
+                                                  binary ? GameArchive::Format::Binary : GameArchive::Format::Ndjson);
+            sqlite3_close(import_db);
 
-        if (status != "active") return crow::response(400, "Game not active");
-        if (*user != p1 && *user != p2) return crow::response(403, "Not a player in this game");
+            crow::json::wvalue out;
+            out["ok"] = result.ok;
+            out["imported"] = result.imported;
+            out["skipped"] = result.skipped;
+            if (!result.ok) out["error"] = result.error;
+            return to_response(std::move(out), result.ok ? 200 : 400);
+        });
+    });
 
-        sqlite3_stmt* upd = nullptr;
-        const char* upd_sql = "UPDATE games SET draw_offer_by=?, updated_at=? WHERE id=?;";
-        if (sqlite3_prepare_v2(db, upd_sql, -1, &upd, nullptr) != SQLITE_OK) {
-            return crow::response(500, "DB error");
-        }
-        sqlite3_bind_text(upd, 1, user->c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int64(upd, 2, (sqlite3_int64)std::time(nullptr));
-        sqlite3_bind_int(upd, 3, game_id);
-        sqlite3_step(upd);
-        sqlite3_finalize(upd);
+    // Starts an online backup of the database; poll GET for progress.
+    CROW_ROUTE(app, "/api/admin/backup").methods(crow::HTTPMethod::Get, crow::HTTPMethod::Post)
+    ([&](const crow::request& req, crow::response& res){
+        offload(db_pool, res, [&]() -> crow::response {
+            auto user = require_user(db, req.get_header_value("Cookie"));
+            if (!user) return crow::response(401, "Login required");
+            if (!is_admin(*user)) return crow::response(403, "Admins only");
 
-        crow::json::wvalue out;
-        out["ok"] = true;
-        out["status"] = "active";
-        out["draw_offer_by"] = *user;
-        return crow::response(out);
+            if (req.method == crow::HTTPMethod::Get) {
+                return to_response(backup_json(maintenance.backupStatus(), maintenance.backupPath()), 200);
+            }
+            auto st = maintenance.backupStatus();
+            if (st.elsewhere || !maintenance.requestBackup()) return to_response(backup_json(st, maintenance.backupPath()), 409);
+            return to_response(backup_json(maintenance.backupStatus(), maintenance.backupPath()), 202);
+        });
     });
 
-    CROW_ROUTE(app, "/api/games/<int>/accept-draw").methods(crow::HTTPMethod::Post)
-    ([&](const crow::request& req, int game_id){
-        auto user = require_user(db, req.get_header_value("Cookie"));
-        if (!user) return crow::response(401, "Login required");
+    // Takebacks: the player who just moved sends {"action":"request"} and
+    // the opponent answers "accept" or "decline". A request lapses once the
+    // opponent moves. Accepting unmakes the move from the flip mask in the
+    // move log, so no earlier boards are stored.
+    CROW_ROUTE(app, "/api/games/<int>/takeback").methods(crow::HTTPMethod::Post)
+    ([&](const crow::request& req, crow::response& res, int game_id){
+        offload(db_pool, res, [&, game_id]() -> crow::response {
+            auto user = require_user(db, req.get_header_value("Cookie"));
+            if (!user) return crow::response(401, "Login required");
+
+            auto body = parse_json(req.body);
+            if (!has_string(body, "action")) {
+                return crow::response(400, "Expected JSON: {\"action\":\"request|accept|decline\"}");
+            }
+            std::string action = body["action"].s();
 
-        sqlite3_stmt* stmt = nullptr;
-        const char* sql = "SELECT player1, player2, status, draw_offer_by FROM games WHERE id=?;";
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            return crow::response(500, "DB error");
-        }
-        sqlite3_bind_int(stmt, 1, game_id);
-        int rc = sqlite3_step(stmt);
-        if (rc != SQLITE_ROW) { sqlite3_finalize(stmt); return crow::response(404, "Game not found"); }
-
-        std::string p1 = (const char*)sqlite3_column_text(stmt, 0);
-        std::string p2 = (const char*)sqlite3_column_text(stmt, 1);
-        std::string status = (const char*)sqlite3_column_text(stmt, 2);
-        const unsigned char* draw_raw = sqlite3_column_text(stmt, 3);
-        std::string draw_offer_by = draw_raw ? (const char*)draw_raw : "";
-        sqlite3_finalize(stmt);
+            sqlite3_stmt* stmt = nullptr;
+            const char* sql =
+                "SELECT player1, player2, turn, status, board, moves, takeback_by,"
+                " clock_ms, increment_ms, p1_ms, p2_ms, turn_started_ms FROM games WHERE id=?;";
+            if (prepare(db, sql, &stmt) != SQLITE_OK) {
+                return crow::response(500, "DB error");
+            }
+            sqlite3_bind_int(stmt, 1, game_id);
+            int rc = sqlite3_step(stmt);
+            if (rc != SQLITE_ROW) { sqlite3_finalize(stmt); return crow::response(404, "Game not found"); }
+
+            std::string p1 = (const char*)sqlite3_column_text(stmt, 0);
+            std::string p2 = (const char*)sqlite3_column_text(stmt, 1);
+            int turn = sqlite3_column_int(stmt, 2);
+            std::string status = (const char*)sqlite3_column_text(stmt, 3);
+            std::string board_json = (const char*)sqlite3_column_text(stmt, 4);
+            std::string moves = (const char*)sqlite3_column_text(stmt, 5);
+            const unsigned char* takeback_raw = sqlite3_column_text(stmt, 6);
+            std::string takeback_by = takeback_raw ? (const char*)takeback_raw : "";
+            MoveClock clock = read_clock(stmt, 7);
+            sqlite3_finalize(stmt);
+
+            if (status != "active") return crow::response(400, "Game not active");
+            if (*user != p1 && *user != p2) return crow::response(403, "Not a player in this game");
+            int side = (*user == p1) ? 1 : -1;
+
+            std::vector<LoggedMove> log;
+            if (!parse_move_log(moves, log)) return crow::response(500, "Corrupt move log");
+            bool can_take_back = !log.empty() && log.back().square >= 0;
+            int last_side = (log.size() % 2 == 1) ? 1 : -1;
+
+            if (action == "request") {
+                if (!can_take_back || last_side != side || turn != -side) {
+                    return crow::response(409, "Nothing to take back");
+                }
+                if (!takeback_by.empty()) return crow::response(409, "Takeback already requested");
 
-        if (status != "active") return crow::response(400, "Game not active");
-        if (*user != p1 && *user != p2) return crow::response(403, "Not a player in this game");
-        if (draw_offer_by.empty()) return crow::response(409, "No draw offer");
-        if (draw_offer_by == *user) return crow::response(409, "You cannot accept your own offer");
+                sqlite3_stmt* upd = nullptr;
+                const char* upd_sql =
+                    "UPDATE games SET revision=revision+1, takeback_by=?, updated_at=? WHERE id=? AND status='active' AND moves=? RETURNING id;";
+                if (prepare(db, upd_sql, &upd) != SQLITE_OK) {
+                    return crow::response(500, "DB error");
+                }
+                sqlite3_bind_text(upd, 1, user->c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_int64(upd, 2, (sqlite3_int64)std::time(nullptr));
+                sqlite3_bind_int(upd, 3, game_id);
+                sqlite3_bind_text(upd, 4, moves.c_str(), -1, SQLITE_TRANSIENT);
+                bool updated = sqlite3_step(upd) == SQLITE_ROW;
+                sqlite3_finalize(upd);
+                if (!updated) return crow::response(409, "Game changed, reload");
+                notify_spectators(db, game_id);
+
+                crow::json::wvalue out;
+                out["ok"] = true;
+                out["status"] = "active";
+                out["takeback_by"] = *user;
+                return to_response(std::move(out));
+            }
 
-        sqlite3_stmt* upd = nullptr;
-        const char* upd_sql = "UPDATE games SET status='draw', draw_offer_by=NULL, updated_at=? WHERE id=?;";
-        if (sqlite3_prepare_v2(db, upd_sql, -1, &upd, nullptr) != SQLITE_OK) {
-            return crow::response(500, "DB error");
-        }
-        sqlite3_bind_int64(upd, 1, (sqlite3_int64)std::time(nullptr));
-        sqlite3_bind_int(upd, 2, game_id);
-        sqlite3_step(upd);
-        sqlite3_finalize(upd);
+            if (action != "accept" && action != "decline") return crow::response(400, "Unknown action");
+            if (takeback_by.empty()) return crow::response(409, "No takeback request");
+            if (takeback_by == *user) return crow::response(409, "You cannot answer your own request");
+
+            if (action == "decline") {
+                sqlite3_stmt* upd = nullptr;
+                const char* upd_sql = "UPDATE games SET revision=revision+1, takeback_by=NULL, updated_at=? WHERE id=? AND takeback_by=?;";
+                if (prepare(db, upd_sql, &upd) != SQLITE_OK) {
+                    return crow::response(500, "DB error");
+                }
+                sqlite3_bind_int64(upd, 1, (sqlite3_int64)std::time(nullptr));
+                sqlite3_bind_int(upd, 2, game_id);
+                sqlite3_bind_text(upd, 3, takeback_by.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_step(upd);
+                sqlite3_finalize(upd);
+                notify_spectators(db, game_id);
+
+                crow::json::wvalue out;
+                out["ok"] = true;
+                out["status"] = "active";
+                out["takeback_by"] = "";
+                return to_response(std::move(out));
+            }
+
+            // Accept: unmake the requester's move and give them the turn back.
+            if (!can_take_back) return crow::response(409, "Nothing to take back");
+            LoggedMove last = log.back();
+
+            auto board = board_from_json(board_json);
+            int size = (int)board.size();
+            if (last.square >= size * size) return crow::response(500, "Corrupt move log");
+            with_board(board, [&](auto& game_board) {
+                game_board.undoPiece(last.square / size, last.square % size, last.flips);
+                board = game_board.getBoard();
+            });
+            std::string new_json = board_to_json(board);
+
+            int mover = -side;
+            int prev_pass = (log.size() >= 2 && log[log.size() - 2].square < 0) ? 1 : 0;
+            std::string prev_moves = moves.substr(0, moves.size() - move_log_entry(last.square, last.flips).size());
+            int64_t now_ms = MoveClock::nowMs();
+            clock.turn_started_ms = now_ms;
+            // The undone move earned the mover an increment; take it back too
+            if (clock.timed) {
+                int64_t& bank = mover == 1 ? clock.p1_ms : clock.p2_ms;
+                bank = std::max<int64_t>(0, bank - clock.increment_ms);
+            }
+
+            sqlite3_stmt* upd = nullptr;
+            const char* upd_sql =
+                "UPDATE games SET revision=revision+1, board=?, turn=?, pass_count=?, moves=?, takeback_by=NULL, draw_offer_by=NULL,"
+                " p1_ms=?, p2_ms=?, turn_started_ms=?, updated_at=? WHERE id=? AND status='active' AND moves=? RETURNING id;";
+            if (prepare(db, upd_sql, &upd) != SQLITE_OK) {
+                return crow::response(500, "DB error");
+            }
+            sqlite3_bind_text(upd, 1, new_json.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(upd, 2, mover);
+            sqlite3_bind_int(upd, 3, prev_pass);
+            sqlite3_bind_text(upd, 4, prev_moves.c_str(), -1, SQLITE_TRANSIENT);
+            bind_clock(upd, 5, clock);
+            sqlite3_bind_int64(upd, 8, (sqlite3_int64)std::time(nullptr));
+            sqlite3_bind_int(upd, 9, game_id);
+            sqlite3_bind_text(upd, 10, moves.c_str(), -1, SQLITE_TRANSIENT);
+            bool updated = sqlite3_step(upd) == SQLITE_ROW;
+            sqlite3_finalize(upd);
+            if (!updated) return crow::response(409, "Game changed, reload");
+            positions.recordMove(PositionIndex::hashBoard(board, mover), size, last.square, -1);
+            timers.arm(game_id, clock.remaining(mover, now_ms, untimed_move_ms));
+            notify_spectators(db, game_id);
+
+            crow::json::wvalue out;
+            out["ok"] = true;
+            out["game_id"] = game_id;
+            out["turn"] = mover;
+            out["pass_count"] = prev_pass;
+            out["status"] = "active";
+            out["draw_offer_by"] = "";
+            out["takeback_by"] = "";
+            add_clock_to_response(out, clock, mover, true);
+            out["board"] = crow::json::wvalue::list();
+            for (size_t r = 0; r < board.size(); r++) {
+                out["board"][r] = crow::json::wvalue::list();
+                for (size_t c = 0; c < board[r].size(); c++) {
+                    out["board"][r][c] = board[r][c];
+                }
+            }
+            return to_response(std::move(out));
+        });
+    });
+
+    // Served from memory; ?limit=N (default 20, at most 100)
+    CROW_ROUTE(app, "/api/leaderboard").methods(crow::HTTPMethod::Get)
+    ([](const crow::request& req){
+        const char* limit_raw = req.url_params.get("limit");
+        int limit = limit_raw ? std::atoi(limit_raw) : 20;
+        if (limit < 1 || limit > 100) return crow::response(400, "limit must be between 1 and 100");
 
         crow::json::wvalue out;
         out["ok"] = true;
-        out["status"] = "draw";
-        return crow::response(out);
+        out["players"] = crow::json::wvalue::list();
+        auto top = leaderboard.top((size_t)limit);
+        for (size_t i = 0; i < top.size(); i++) {
+            auto& p = out["players"][i];
+            p["rank"] = (int)i + 1;
+            p["username"] = top[i].username;
+            p["rating"] = top[i].rating;
+            p["wins"] = top[i].wins;
+            p["losses"] = top[i].losses;
+            p["draws"] = top[i].draws;
+        }
+        return to_response(std::move(out));
     });
 
-    app.port(18080).run();
+    CROW_ROUTE(app, "/api/users/<string>/stats").methods(crow::HTTPMethod::Get)
+    ([&](const crow::request&, crow::response& res, std::string username){
+        offload(db_pool, res, [&, username]() -> crow::response {
+            sqlite3_stmt* stmt = nullptr;
+            const char* sql =
+                "SELECT u.rating, s.wins, s.losses, s.draws, s.resignations"
+                " FROM users u LEFT JOIN player_stats s ON s.username=u.username WHERE u.username=?;";
+            if (prepare(db, sql, &stmt) != SQLITE_OK) {
+                return crow::response(500, "DB error");
+            }
+            sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
+            if (sqlite3_step(stmt) != SQLITE_ROW) { sqlite3_finalize(stmt); return crow::response(404, "User not found"); }
+
+            crow::json::wvalue out;
+            out["ok"] = true;
+            out["username"] = username;
+            out["rating"] = sqlite3_column_int(stmt, 0);
+            out["wins"] = sqlite3_column_int(stmt, 1);
+            out["losses"] = sqlite3_column_int(stmt, 2);
+            out["draws"] = sqlite3_column_int(stmt, 3);
+            out["resignations"] = sqlite3_column_int(stmt, 4);
+            sqlite3_finalize(stmt);
+            return to_response(std::move(out));
+        });
+    });
+
+    // Keep in sync with the CROW_ROUTEs above; anything else is "other".
+    for (const char* route : {
+             "/", "/metrics", "/debug/trace", "/api/hello", "/api/analyze", "/api/analyze/batch", "/api/analyze-positions", "/api/reverse",
+             "/api/submissions", "/api/register", "/api/login", "/api/logout", "/api/me",
+             "/api/games/create", "/api/games/export", "/api/games/import", "/api/admin/backup", "/api/matchmaking/join", "/api/matchmaking/status", "/api/matchmaking/leave",
+             "/api/games/<int>/state", "/api/games/<int>/watch", "/api/games/active", "/api/games/<int>/move",
+             "/api/games/<int>/resign", "/api/games/<int>/offer-draw", "/api/games/<int>/accept-draw", "/api/games/<int>/takeback",
+             "/api/leaderboard", "/api/users/<string>/stats", "/api/positions/<string>",
+         }) {
+        app.get_middleware<MetricsMiddleware>().registerRoute(route);
+    }
+
+    // Crow's I/O threads inherit the main thread's affinity.
+    if (!io_cpus.empty() && !pin_current_thread(io_cpus)) {
+        std::cerr << "IO_CPUS ignored: CPU pinning is not supported here\n";
+    }
+
+    app.port(18080).concurrency((uint16_t)(http_threads > 0 ? http_threads : 1)).run();
+
+    // Nothing may submit more work once the pools are down, and the jobs
+    // still queued refer to the timers, the matchmaker and responses of
+    // connections that are gone, so drop them before any of those are.
+    running = false;
+    if (matchmaking_thread.joinable()) matchmaking_thread.join();
+    if (channel) channel->stop();
+    db_pool.shutdown();
+    analysis_pool.shutdown();
+    wheel.stop();
+    maintenance.stop();
+    close_results_connection();
+    return 0;
+}
+
+int main() {
+    // WORKERS=N runs N copies of the server sharing port 18080 under a
+    // supervisor that restarts them; see prefork.h.
+    int workers = env_int("WORKERS", 1);
+    if (workers <= 1) return serve(-1, 0);
+
+    Matchmaker matchmaker;
+    Supervisor::Hooks hooks;
+    hooks.on_call = [&](const std::string& request) { return matchmaking_request(matchmaker, request); };
+    hooks.on_tick = [&] {
+        std::vector<std::string> out;
+        for (const MatchPair& pair : matchmaker.sweep(Matchmaker::Clock::now())) {
+            out.push_back(join_fields({"match", pair.player1, pair.player2}));
+        }
+        return out;
+    };
+    return Supervisor::run(workers, [](int index, int fd) { return serve(fd, index); }, hooks);
 }
@@ -0,0 +1,209 @@
+#include "db_maintenance.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+using namespace std;
+
+namespace {
+int64_t unix_ms() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+}
+
+DbMaintenance::~DbMaintenance() {
+    stop();
+}
+
+bool DbMaintenance::start(const string& db_path, const Options& opts) {
+    options = opts;
+    error_code ec;
+    filesystem::path parent = filesystem::path(options.backup_path).parent_path();
+    if (!parent.empty()) filesystem::create_directories(parent, ec);
+    lock_fd = ::open((options.backup_path + ".lock").c_str(), O_RDWR | O_CREAT, 0644);
+    if (lock_fd < 0) return false;
+    if (sqlite3_open(db_path.c_str(), &db) != SQLITE_OK) {
+        sqlite3_close(db);
+        db = nullptr;
+        ::close(lock_fd);
+        lock_fd = -1;
+        return false;
+    }
+    // TRUNCATE checkpoints briefly block writers; rather give up than
+    // hold them for long
+    sqlite3_busy_timeout(db, 200);
+
+    stopping = false;
+    next_checkpoint = Clock::now() + options.checkpoint_interval;
+    worker = thread([this] { run(); });
+    return true;
+}
+
+void DbMaintenance::stop() {
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (worker.joinable()) worker.join();
+    if (db) sqlite3_close(db);
+    db = nullptr;
+    if (lock_fd >= 0) ::close(lock_fd);
+    lock_fd = -1;
+}
+
+bool DbMaintenance::requestBackup() {
+    {
+        lock_guard<mutex> lock(mtx);
+        if (backup_requested || status.state == BackupStatus::State::Running) return false;
+        backup_requested = true;
+        // Report it as running from now, not from when the thread wakes
+        status = BackupStatus();
+        status.state = BackupStatus::State::Running;
+        status.started_ms = unix_ms();
+    }
+    cv.notify_all();
+    return true;
+}
+
+DbMaintenance::BackupStatus DbMaintenance::backupStatus() {
+    BackupStatus out;
+    {
+        lock_guard<mutex> lock(mtx);
+        out = status;
+    }
+    // While this process isn't holding the lock, see whether another one
+    // is. The probe needs a file description of its own: flock() calls on
+    // lock_fd would act on our own lock instead of testing for others.
+    if (out.state != BackupStatus::State::Running && !backing_up) {
+        int probe = ::open((options.backup_path + ".lock").c_str(), O_RDONLY);
+        if (probe >= 0) {
+            out.elsewhere = flock(probe, LOCK_SH | LOCK_NB) != 0 && errno == EWOULDBLOCK;
+            ::close(probe);
+        }
+    }
+    return out;
+}
+
+bool DbMaintenance::pause(chrono::milliseconds d) {
+    unique_lock<mutex> lock(mtx);
+    return !cv.wait_for(lock, d, [this] { return stopping; });
+}
+
+void DbMaintenance::run() {
+    auto next_backup = Clock::now() + options.backup_interval;
+    unique_lock<mutex> lock(mtx);
+    while (!stopping) {
+        auto now = Clock::now();
+        if (options.backup_interval.count() > 0 && now >= next_backup) {
+            backup_requested = true;
+            next_backup = now + options.backup_interval;
+        }
+        if (backup_requested) {
+            backup_requested = false;
+            lock.unlock();
+            runBackup();
+            lock.lock();
+            continue;
+        }
+        if (now >= next_checkpoint) {
+            lock.unlock();
+            checkpoint();
+            lock.lock();
+            continue;
+        }
+        auto wake = next_checkpoint;
+        if (options.backup_interval.count() > 0 && next_backup < wake) wake = next_backup;
+        cv.wait_until(lock, wake, [this] { return stopping || backup_requested; });
+    }
+}
+
+void DbMaintenance::checkpoint() {
+    static const int latency = Metrics::histogram("db_checkpoint_duration_seconds", "Time spent in scheduled WAL checkpoints.");
+    ScopedTimer timer(latency);
+    next_checkpoint = Clock::now() + options.checkpoint_interval;
+    int wal_pages = 0;
+    int rc = sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_PASSIVE, &wal_pages, nullptr);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "WAL checkpoint failed: %s\n", sqlite3_errstr(rc));
+        return;
+    }
+    // Under steady writes a passive checkpoint never catches up with the
+    // end of the log, which SQLite only rewinds once it has all been
+    // copied back. The passive pass leaves little for this one to copy
+    // while it holds writers off.
+    if (wal_pages >= options.wal_limit_pages) {
+        sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_TRUNCATE, nullptr, nullptr);
+    }
+}
+
+void DbMaintenance::runBackup() {
+    auto finish = [this](BackupStatus::State state, const string& error) {
+        lock_guard<mutex> lock(mtx);
+        status.state = state;
+        status.error = error;
+        status.finished_ms = unix_ms();
+    };
+    {
+        lock_guard<mutex> lock(mtx);
+        status = BackupStatus();
+        status.state = BackupStatus::State::Running;
+        status.started_ms = unix_ms();
+    }
+    backing_up = true;
+    if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+        backing_up = false;
+        finish(BackupStatus::State::Failed, "another process is taking a backup");
+        return;
+    }
+
+    string tmp = options.backup_path + ".tmp";
+    remove(tmp.c_str());
+    sqlite3* dest = nullptr;
+    int rc = sqlite3_open(tmp.c_str(), &dest);
+    sqlite3_backup* backup = nullptr;
+    // Reading inside one transaction pins a snapshot: without it, every
+    // write by another connection would restart the copy from page one.
+    bool in_txn = false;
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_exec(db, "BEGIN; SELECT count(*) FROM sqlite_master;", nullptr, nullptr, nullptr);
+        in_txn = sqlite3_get_autocommit(db) == 0;
+    }
+    if (rc == SQLITE_OK) {
+        backup = sqlite3_backup_init(dest, "main", db, "main");
+        if (!backup) rc = sqlite3_errcode(dest);
+    }
+    while (backup) {
+        rc = sqlite3_backup_step(backup, options.pages_per_step);
+        {
+            lock_guard<mutex> lock(mtx);
+            status.pages_total = sqlite3_backup_pagecount(backup);
+            status.pages_done = status.pages_total - sqlite3_backup_remaining(backup);
+        }
+        // No checkpoints meanwhile: inside our read transaction they fail
+        // with SQLITE_LOCKED. One that comes due runs right after.
+        if (rc != SQLITE_OK && rc != SQLITE_BUSY && rc != SQLITE_LOCKED) break;
+        if (!pause(options.step_pause)) {
+            rc = SQLITE_INTERRUPT;
+            break;
+        }
+    }
+    if (backup) sqlite3_backup_finish(backup);
+    if (in_txn) sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+    sqlite3_close(dest);
+
+    if (rc == SQLITE_DONE && rename(tmp.c_str(), options.backup_path.c_str()) == 0) {
+        finish(BackupStatus::State::Done, "");
+    } else {
+        remove(tmp.c_str());
+        finish(BackupStatus::State::Failed, rc == SQLITE_DONE ? "could not replace the old backup" : sqlite3_errstr(rc));
+    }
+    flock(lock_fd, LOCK_UN);
+    backing_up = false;
+}
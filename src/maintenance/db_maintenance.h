@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <sqlite3.h>
+
+// Background upkeep for a SQLite database in WAL mode, run on one thread
+// with its own connection.
+//
+// Backups copy the database with sqlite3_backup_step, `pages_per_step`
+// pages at a time with a pause between batches, into "<backup_path>.tmp",
+// which replaces backup_path once complete. The copy runs inside one read
+// transaction, so it is a consistent snapshot while writers carry on
+// undisturbed. One backup runs at a time, also across processes sharing
+// backup_path (an flock on "<backup_path>.lock").
+//
+// Checkpoints run every `checkpoint_interval` instead of on whichever
+// commit crosses SQLite's threshold. They are PASSIVE, so they neither
+// wait for nor hold up other connections, unless the WAL has passed
+// `wal_limit_pages`: then a TRUNCATE checkpoint briefly holds writers off
+// to copy back the rest and empty the file, so the WAL stays bounded
+// under sustained writes. A checkpoint that comes due during a backup runs once the backup
+// has finished, since the backup's read transaction would block it.
+class DbMaintenance {
+public:
+    struct Options {
+        std::string backup_path = "backups/app.db";
+        int pages_per_step = 256;
+        std::chrono::milliseconds step_pause{20};
+        std::chrono::seconds backup_interval{0}; // 0 = only when asked
+        std::chrono::seconds checkpoint_interval{30};
+        int wal_limit_pages = 4096;
+    };
+
+    struct BackupStatus {
+        enum class State { Idle, Running, Done, Failed };
+        State state = State::Idle;
+        bool elsewhere = false; // running in another process
+        int pages_total = 0;
+        int pages_done = 0;
+        int64_t started_ms = 0; // unix time
+        int64_t finished_ms = 0;
+        std::string error;
+    };
+
+    DbMaintenance() = default;
+    ~DbMaintenance();
+    DbMaintenance(const DbMaintenance&) = delete;
+    DbMaintenance& operator=(const DbMaintenance&) = delete;
+
+    // Opens its own connection to `db_path` and starts the thread. Returns
+    // false if the database or the lock file can't be opened.
+    bool start(const std::string& db_path, const Options& options);
+    // Abandons a backup in progress and joins. Idempotent.
+    void stop();
+
+    // Starts a backup soon; false if one is already queued or running
+    bool requestBackup();
+    BackupStatus backupStatus();
+    const std::string& backupPath() const { return options.backup_path; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    Options options;
+    sqlite3* db = nullptr;
+    int lock_fd = -1;
+    // Set while this process holds the backup lock
+    std::atomic<bool> backing_up{false};
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping = false;
+    bool backup_requested = false;
+    BackupStatus status;
+    Clock::time_point next_checkpoint;
+
+    void run();
+    void runBackup();
+    void checkpoint();
+    // Sleeps for `d` unless stop() is called first; false if it was
+    bool pause(std::chrono::milliseconds d);
+};
@@ -0,0 +1,132 @@
+#include "matchmaking.h"
+
+using namespace std;
+
+Matchmaker::Matchmaker(int base_window, int widen_per_sec, int max_window)
+    : base_window(base_window), widen_per_sec(widen_per_sec), max_window(max_window) {}
+
+int Matchmaker::windowFor(Clock::time_point since, Clock::time_point now) const {
+    auto waited = chrono::duration_cast<chrono::milliseconds>(now - since).count();
+    long long w = base_window + (long long)widen_per_sec * waited / 1000;
+    return (int)(w < max_window ? w : max_window);
+}
+
+void Matchmaker::add(const string& user, int rating, Clock::time_point since) {
+    Key key{rating, next_seq++};
+    by_rating[key] = Ticket{user, since};
+    by_age[key.seq] = rating;
+    by_user[user] = key;
+}
+
+void Matchmaker::remove(const Key& key) {
+    auto it = by_rating.find(key);
+    if (it == by_rating.end()) return;
+    by_user.erase(it->second.user);
+    by_age.erase(key.seq);
+    by_rating.erase(it);
+}
+
+optional<Matchmaker::Key> Matchmaker::closest(const Key& key, int window) const {
+    auto it = by_rating.find(key);
+    optional<Key> best;
+    int best_gap = window + 1;
+
+    if (it != by_rating.begin()) {
+        auto lo = prev(it);
+        int gap = key.rating - lo->first.rating;
+        if (gap < best_gap) { best = lo->first; best_gap = gap; }
+    }
+    auto hi = next(it);
+    if (hi != by_rating.end()) {
+        int gap = hi->first.rating - key.rating;
+        if (gap < best_gap) best = hi->first;
+    }
+    return best;
+}
+
+// The player who has waited longer gets the first move.
+MatchPair Matchmaker::take(const Key& a, const Key& b) {
+    const Key& older = a.seq < b.seq ? a : b;
+    const Key& newer = a.seq < b.seq ? b : a;
+    MatchPair pair{by_rating[older].user, by_rating[newer].user};
+    remove(older);
+    remove(newer);
+    return pair;
+}
+
+optional<MatchPair> Matchmaker::join(const string& user, int rating, Clock::time_point now) {
+    lock_guard<mutex> lock(mtx);
+    if (by_user.count(user)) return nullopt;
+    matches.erase(user);
+
+    add(user, rating, now);
+    Key key = by_user[user];
+    // Only the newcomer's base window here; a long-waiting player whose
+    // window has grown to reach them pairs up in the next sweep().
+    auto opp = closest(key, base_window);
+    if (!opp) return nullopt;
+    return take(key, *opp);
+}
+
+bool Matchmaker::leave(const string& user) {
+    lock_guard<mutex> lock(mtx);
+    auto it = by_user.find(user);
+    if (it == by_user.end()) return false;
+    remove(it->second);
+    return true;
+}
+
+vector<MatchPair> Matchmaker::sweep(Clock::time_point now) {
+    lock_guard<mutex> lock(mtx);
+    vector<MatchPair> pairs;
+    auto it = by_age.begin();
+    while (it != by_age.end()) {
+        Key key{it->second, it->first};
+        ++it;
+        auto t = by_rating.find(key);
+        if (t == by_rating.end()) continue; // paired earlier in this sweep
+        auto opp = closest(key, windowFor(t->second.since, now));
+        if (!opp) continue;
+        // `it` may point at the opponent, which is about to be erased.
+        if (it != by_age.end() && it->first == opp->seq) ++it;
+        pairs.push_back(take(key, *opp));
+    }
+    return pairs;
+}
+
+void Matchmaker::recordMatch(const MatchPair& pair, int game_id) {
+    lock_guard<mutex> lock(mtx);
+    matches[pair.player1] = game_id;
+    matches[pair.player2] = game_id;
+}
+
+void Matchmaker::requeue(const string& user, int rating, Clock::time_point since) {
+    lock_guard<mutex> lock(mtx);
+    if (by_user.count(user)) return;
+    add(user, rating, since);
+}
+
+Matchmaker::Status Matchmaker::status(const string& user, Clock::time_point now) {
+    lock_guard<mutex> lock(mtx);
+    Status s;
+    auto m = matches.find(user);
+    if (m != matches.end()) {
+        s.state = Status::Matched;
+        s.game_id = m->second;
+        matches.erase(m);
+        return s;
+    }
+    auto w = by_user.find(user);
+    if (w != by_user.end()) {
+        const Ticket& t = by_rating[w->second];
+        s.state = Status::Waiting;
+        s.waited_s = chrono::duration<double>(now - t.since).count();
+        s.window = windowFor(t.since, now);
+    }
+    return s;
+}
+
+size_t Matchmaker::waitingCount() {
+    lock_guard<mutex> lock(mtx);
+    return by_rating.size();
+}
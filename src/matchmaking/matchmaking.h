@@ -0,0 +1,86 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct MatchPair {
+    std::string player1;
+    std::string player2;
+};
+
+// In-memory matchmaking queue.
+//
+// Waiting players are kept in an ordered set keyed by (rating, arrival),
+// so the closest-rated opponent on either side of a rating is found with
+// one O(log n) lookup. A player's acceptable rating gap starts at
+// `base_window` and widens by `widen_per_sec` for every second waited, up
+// to `max_window`; sweep() re-checks waiting players as their windows
+// grow. Thread-safe.
+class Matchmaker {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Status {
+        enum State { Idle, Waiting, Matched } state = Idle;
+        int game_id = 0;       // when Matched
+        double waited_s = 0;   // when Waiting
+        int window = 0;        // when Waiting
+    };
+
+    Matchmaker(int base_window = 50, int widen_per_sec = 10, int max_window = 500);
+
+    // Queues `user`, or pairs them right away if someone close enough in
+    // rating is waiting. Joining again while queued is a no-op.
+    std::optional<MatchPair> join(const std::string& user, int rating, Clock::time_point now);
+    bool leave(const std::string& user);
+
+    // Pairs waiting players whose widened windows now overlap, oldest
+    // first. Called periodically.
+    std::vector<MatchPair> sweep(Clock::time_point now);
+
+    // Records the game created for a pair so both players can pick it up.
+    void recordMatch(const MatchPair& pair, int game_id);
+    // Puts a player back in the queue with their original wait time, e.g.
+    // when their opponent turned out to be unavailable.
+    void requeue(const std::string& user, int rating, Clock::time_point since);
+
+    // Reports (and forgets) a recorded match, else the queue state.
+    Status status(const std::string& user, Clock::time_point now);
+    size_t waitingCount();
+
+private:
+    struct Key {
+        int rating;
+        uint64_t seq;
+        bool operator<(const Key& o) const {
+            return rating != o.rating ? rating < o.rating : seq < o.seq;
+        }
+    };
+    struct Ticket {
+        std::string user;
+        Clock::time_point since;
+    };
+
+    std::mutex mtx;
+    std::map<Key, Ticket> by_rating;
+    std::map<uint64_t, int> by_age;                   // seq -> rating, oldest first
+    std::unordered_map<std::string, Key> by_user;
+    std::unordered_map<std::string, int> matches;     // user -> game_id, until read
+    uint64_t next_seq = 0;
+    int base_window;
+    int widen_per_sec;
+    int max_window;
+
+    int windowFor(Clock::time_point since, Clock::time_point now) const;
+    void add(const std::string& user, int rating, Clock::time_point since);
+    void remove(const Key& key);
+    // Closest waiting opponent for `key` within `window`, excluding itself
+    std::optional<Key> closest(const Key& key, int window) const;
+    MatchPair take(const Key& a, const Key& b);
+};
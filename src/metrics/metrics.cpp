@@ -0,0 +1,168 @@
+#include "metrics.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+
+using namespace std;
+
+namespace {
+
+const int kMaxSeries = 128;
+const int kBuckets = 56; // 1us, then 2 per octave over 27 octaves, plus overflow
+
+struct Series {
+    string name;
+    string help;
+    string labels;
+    bool isHistogram;
+};
+
+struct Shard {
+    atomic<uint64_t> count[kMaxSeries];
+    atomic<uint64_t> sumNanos[kMaxSeries];
+    atomic<uint64_t> buckets[kMaxSeries][kBuckets];
+
+    Shard() {
+        for (int i = 0; i < kMaxSeries; i++) {
+            count[i].store(0, memory_order_relaxed);
+            sumNanos[i].store(0, memory_order_relaxed);
+            for (int b = 0; b < kBuckets; b++) buckets[i][b].store(0, memory_order_relaxed);
+        }
+    }
+};
+
+mutex registry_mtx;
+vector<Series> series;        // guarded by registry_mtx
+vector<Shard*> shards;        // guarded by registry_mtx; never freed
+
+Shard& localShard() {
+    thread_local Shard* shard = nullptr;
+    if (!shard) {
+        shard = new Shard();
+        lock_guard<mutex> lock(registry_mtx);
+        shards.push_back(shard);
+    }
+    return *shard;
+}
+
+// Only the owning thread writes a shard, so load + store is enough.
+inline void bump(atomic<uint64_t>& a, uint64_t n) {
+    a.store(a.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// Bucket b holds observations up to and including bucketNanos(b): 1us,
+// 1.5us, 2us, 3us, 4us, 6us, ... The last bucket is the overflow.
+uint64_t bucketNanos(int b) {
+    return (b % 2 ? 1500ull : 1000ull) << (b / 2);
+}
+
+int bucketFor(uint64_t nanos) {
+    // Every bound is a whole number of 500ns units of the form 2^k or
+    // 3*2^k, so comparing in those units (rounded up) is exact.
+    uint64_t u = nanos / 500 + (nanos % 500 != 0);
+    if (u <= 2) return 0;
+    int e = 63 - __builtin_clzll(u);
+    int b;
+    if (u == (1ull << e)) b = 2 * (e - 1);
+    else if (u <= 3ull << (e - 1)) b = 2 * (e - 1) + 1;
+    else b = 2 * e;
+    return b < kBuckets - 1 ? b : kBuckets - 1;
+}
+
+// Inclusive upper bound of bucket b, in seconds, as Prometheus' le
+string bucketBound(int b) {
+    ostringstream out;
+    out << setprecision(9) << (double)bucketNanos(b) / 1e9;
+    return out.str();
+}
+
+int registerSeries(const string& name, const string& help, const string& labels, bool isHistogram) {
+    lock_guard<mutex> lock(registry_mtx);
+    for (size_t i = 0; i < series.size(); i++) {
+        if (series[i].name == name && series[i].labels == labels) return (int)i;
+    }
+    if ((int)series.size() >= kMaxSeries) return -1;
+    series.push_back(Series{name, help, labels, isHistogram});
+    return (int)series.size() - 1;
+}
+
+string withLabel(const string& labels, const string& extra) {
+    if (labels.empty()) return "{" + extra + "}";
+    return "{" + labels + "," + extra + "}";
+}
+
+// Caller holds registry_mtx.
+void renderSeries(ostringstream& out, int i) {
+    const Series& m = series[i];
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t buckets[kBuckets] = {};
+    for (Shard* s : shards) {
+        count += s->count[i].load(memory_order_relaxed);
+        sum += s->sumNanos[i].load(memory_order_relaxed);
+        if (m.isHistogram) {
+            for (int b = 0; b < kBuckets; b++) buckets[b] += s->buckets[i][b].load(memory_order_relaxed);
+        }
+    }
+
+    string braces = m.labels.empty() ? "" : "{" + m.labels + "}";
+    if (!m.isHistogram) {
+        out << m.name << braces << " " << count << "\n";
+        return;
+    }
+
+    uint64_t cumulative = 0;
+    for (int b = 0; b < kBuckets - 1; b++) {
+        cumulative += buckets[b];
+        out << m.name << "_bucket" << withLabel(m.labels, "le=\"" + bucketBound(b) + "\"") << " " << cumulative << "\n";
+    }
+    out << m.name << "_bucket" << withLabel(m.labels, "le=\"+Inf\"") << " " << count << "\n";
+    out << m.name << "_sum" << braces << " " << (double)sum / 1e9 << "\n";
+    out << m.name << "_count" << braces << " " << count << "\n";
+}
+
+}
+
+int Metrics::histogram(const string& name, const string& help, const string& labels) {
+    return registerSeries(name, help, labels, true);
+}
+
+int Metrics::counter(const string& name, const string& help, const string& labels) {
+    return registerSeries(name, help, labels, false);
+}
+
+void Metrics::observe(int id, uint64_t nanos) {
+    if (id < 0) return;
+    Shard& s = localShard();
+    bump(s.count[id], 1);
+    bump(s.sumNanos[id], nanos);
+    bump(s.buckets[id][bucketFor(nanos)], 1);
+}
+
+void Metrics::inc(int id, uint64_t n) {
+    if (id < 0) return;
+    bump(localShard().count[id], n);
+}
+
+string Metrics::renderPrometheus() {
+    lock_guard<mutex> lock(registry_mtx);
+    ostringstream out;
+    out << setprecision(9);
+
+    // A metric family has to be contiguous, but its series may have been
+    // registered at different times, so emit them grouped by name.
+    vector<bool> done(series.size(), false);
+    for (size_t first = 0; first < series.size(); first++) {
+        if (done[first]) continue;
+        out << "# HELP " << series[first].name << " " << series[first].help << "\n";
+        out << "# TYPE " << series[first].name << " " << (series[first].isHistogram ? "histogram" : "counter") << "\n";
+        for (size_t i = first; i < series.size(); i++) {
+            if (done[i] || series[i].name != series[first].name) continue;
+            done[i] = true;
+            renderSeries(out, (int)i);
+        }
+    }
+    return out.str();
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+// Process-wide counters and latency histograms.
+//
+// Every thread writes to its own shard, so recording is a couple of plain
+// relaxed stores with no locks or shared cache lines. Shards are summed when
+// the metrics are rendered. Histogram buckets are log-spaced, two per
+// power of two, from 1us to about 2 minutes.
+class Metrics {
+public:
+    // Registers a series and returns its id. Registering the same
+    // name + labels again returns the existing id. `labels` is the
+    // pre-formatted label set, e.g. route="/api/me".
+    static int histogram(const std::string& name, const std::string& help, const std::string& labels = "");
+    static int counter(const std::string& name, const std::string& help, const std::string& labels = "");
+
+    static void observe(int id, uint64_t nanos);
+    static void inc(int id, uint64_t n = 1);
+
+    // Prometheus text exposition format (version 0.0.4)
+    static std::string renderPrometheus();
+};
+
+class ScopedTimer {
+private:
+    int id;
+    std::chrono::steady_clock::time_point start;
+public:
+    explicit ScopedTimer(int id) : id(id), start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        Metrics::observe(id, (uint64_t)ns);
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
@@ -0,0 +1,84 @@
+#include "metrics_middleware.h"
+#include "metrics.h"
+#include <string_view>
+
+using namespace std;
+
+static vector<string> split_path(const string& path) {
+    vector<string> out;
+    size_t pos = 0;
+    while (pos < path.size()) {
+        size_t end = path.find('/', pos);
+        if (end == string::npos) end = path.size();
+        if (end > pos) out.push_back(path.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    return out;
+}
+
+static bool all_digits(string_view s) {
+    if (s.empty()) return false;
+    for (char c : s) if (c < '0' || c > '9') return false;
+    return true;
+}
+
+void MetricsMiddleware::registerRoute(const string& pattern) {
+    string labels = "route=\"" + pattern + "\"";
+    routes.push_back(Route{
+        split_path(pattern),
+        Metrics::histogram("http_request_duration_seconds", "HTTP request latency by route.", labels),
+        Metrics::counter("http_server_errors_total", "HTTP responses with a 5xx status, by route.", labels),
+    });
+}
+
+const MetricsMiddleware::Route* MetricsMiddleware::match(const string& url) const {
+    // Split without allocating; nobody registers routes this deep.
+    string_view parts[16];
+    size_t n = 0;
+    string_view rest(url);
+    while (!rest.empty()) {
+        size_t end = rest.find('/');
+        string_view seg = rest.substr(0, end);
+        if (!seg.empty()) {
+            if (n == 16) return nullptr;
+            parts[n++] = seg;
+        }
+        if (end == string_view::npos) break;
+        rest.remove_prefix(end + 1);
+    }
+
+    for (const Route& r : routes) {
+        if (r.segments.size() != n) continue;
+        bool ok = true;
+        for (size_t i = 0; i < n && ok; i++) {
+            const string& seg = r.segments[i];
+            if (seg == "<int>") ok = all_digits(parts[i]);
+            else if (seg != "<string>") ok = (parts[i] == seg);
+        }
+        if (ok) return &r;
+    }
+    return nullptr;
+}
+
+void MetricsMiddleware::before_handle(crow::request&, crow::response&, context& ctx) {
+    ctx.start = chrono::steady_clock::now();
+}
+
+void MetricsMiddleware::after_handle(crow::request& req, crow::response& res, context& ctx) {
+    auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - ctx.start).count();
+
+    int latency, errors;
+    if (const Route* r = match(req.url)) {
+        latency = r->latency;
+        errors = r->errors;
+    } else {
+        // Registered lazily so "other" only shows up once it has traffic.
+        static const int lat = Metrics::histogram("http_request_duration_seconds", "HTTP request latency by route.", "route=\"other\"");
+        static const int err = Metrics::counter("http_server_errors_total", "HTTP responses with a 5xx status, by route.", "route=\"other\"");
+        latency = lat;
+        errors = err;
+    }
+
+    Metrics::observe(latency, (uint64_t)ns);
+    if (res.code >= 500) Metrics::inc(errors);
+}
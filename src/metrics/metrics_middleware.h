@@ -0,0 +1,30 @@
+#pragma once
+#include <crow.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Times every request and records it against the route pattern it matched
+// ("/api/games/<int>/move"), so ids in the path don't explode the series
+// count. Routes must be registered before the app starts; the table is
+// read-only afterwards. Unregistered paths are recorded as "other".
+struct MetricsMiddleware {
+    struct context {
+        std::chrono::steady_clock::time_point start;
+    };
+
+    void registerRoute(const std::string& pattern);
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+
+private:
+    struct Route {
+        std::vector<std::string> segments;
+        int latency;
+        int errors;
+    };
+    std::vector<Route> routes;
+
+    const Route* match(const std::string& url) const;
+};
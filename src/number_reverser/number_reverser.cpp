@@ -1,4 +1,15 @@
 #include "number_reverser.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define NUMBER_REVERSER_X86 1
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
@@ -12,3 +23,275 @@ vector<int> NumberReverser::reverse(const vector<int>& nums) {
 
     return out;
 }
+
+namespace {
+
+#ifdef NUMBER_REVERSER_X86
+
+// Each kernel swaps a block from the front with a block from the back,
+// reversing lanes on the way, and returns how far it got from each end.
+size_t reverseSse2(int* p, size_t n) {
+    size_t lo = 0, hi = n;
+    while (hi - lo >= 8) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(p + lo));
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + hi - 4));
+        _mm_storeu_si128((__m128i*)(p + lo), _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 1, 2, 3)));
+        _mm_storeu_si128((__m128i*)(p + hi - 4), _mm_shuffle_epi32(a, _MM_SHUFFLE(0, 1, 2, 3)));
+        lo += 4;
+        hi -= 4;
+    }
+    return lo;
+}
+
+__attribute__((target("avx2")))
+size_t reverseAvx2(int* p, size_t n) {
+    const __m256i idx = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    size_t lo = 0, hi = n;
+    while (hi - lo >= 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(p + lo));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(p + hi - 8));
+        _mm256_storeu_si256((__m256i*)(p + lo), _mm256_permutevar8x32_epi32(b, idx));
+        _mm256_storeu_si256((__m256i*)(p + hi - 8), _mm256_permutevar8x32_epi32(a, idx));
+        lo += 8;
+        hi -= 8;
+    }
+    return lo;
+}
+
+bool hasAvx2() {
+    static const bool yes = __builtin_cpu_supports("avx2");
+    return yes;
+}
+
+#endif
+
+// Containers nested deeper than this are rejected rather than recursed into
+const int kMaxDepth = 64;
+
+bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool isHex(char c) {
+    return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+void skipSpace(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+}
+
+bool skipString(const char*& p, const char* end) {
+    if (p >= end || *p != '"') return false;
+    for (p++; p < end; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c < 0x20) return false;
+        if (c == '"') { p++; return true; }
+        if (c != '\\') continue;
+        if (++p >= end) return false;
+        if (*p == 'u') {
+            if (end - p < 5 || !isHex(p[1]) || !isHex(p[2]) || !isHex(p[3]) || !isHex(p[4])) return false;
+            p += 4;
+        } else if (*p == '\0' || !strchr("\"\\/bfnrt", *p)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+bool skipNumber(const char*& p, const char* end) {
+    if (p < end && *p == '-') p++;
+    if (p >= end || !isDigit(*p)) return false;
+    if (*p == '0') p++;
+    else while (p < end && isDigit(*p)) p++;
+    if (p < end && *p == '.') {
+        p++;
+        if (p >= end || !isDigit(*p)) return false;
+        while (p < end && isDigit(*p)) p++;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) p++;
+        if (p >= end || !isDigit(*p)) return false;
+        while (p < end && isDigit(*p)) p++;
+    }
+    return true;
+}
+
+bool skipLiteral(const char*& p, const char* end, const char* word) {
+    size_t n = strlen(word);
+    if ((size_t)(end - p) < n || memcmp(p, word, n) != 0) return false;
+    p += n;
+    return true;
+}
+
+// Skips one JSON value, checking its syntax on the way.
+bool skipValue(const char*& p, const char* end, int depth = 0) {
+    skipSpace(p, end);
+    if (p >= end) return false;
+    switch (*p) {
+    case '"': return skipString(p, end);
+    case 't': return skipLiteral(p, end, "true");
+    case 'f': return skipLiteral(p, end, "false");
+    case 'n': return skipLiteral(p, end, "null");
+    case '{':
+    case '[': {
+        if (depth >= kMaxDepth) return false;
+        char close = *p == '{' ? '}' : ']';
+        p++;
+        skipSpace(p, end);
+        if (p < end && *p == close) { p++; return true; }
+        while (true) {
+            if (close == '}') {
+                skipSpace(p, end);
+                if (!skipString(p, end)) return false;
+                skipSpace(p, end);
+                if (p >= end || *p != ':') return false;
+                p++;
+            }
+            if (!skipValue(p, end, depth + 1)) return false;
+            skipSpace(p, end);
+            if (p >= end) return false;
+            if (*p == close) { p++; return true; }
+            if (*p != ',') return false;
+            p++;
+        }
+    }
+    default: return skipNumber(p, end);
+    }
+}
+
+// Whole numbers written with a fraction or exponent, e.g. 1.0 or 1e3
+bool parseIntegralNumber(const char* begin, const char* end, int& out) {
+    string text(begin, end);
+    char* stop = nullptr;
+    double v = strtod(text.c_str(), &stop);
+    if (stop != text.c_str() + text.size() || v != floor(v)) return false;
+    if (v < numeric_limits<int>::min() || v > numeric_limits<int>::max()) return false;
+    out = (int)v;
+    return true;
+}
+
+bool parseIntArray(const char*& p, const char* end, vector<int>& out) {
+    skipSpace(p, end);
+    if (p >= end || *p != '[') return false;
+    p++;
+    skipSpace(p, end);
+    if (p < end && *p == ']') { p++; return true; }
+
+    while (p < end) {
+        skipSpace(p, end);
+        const char* start = p;
+        bool neg = false;
+        if (p < end && *p == '-') { neg = true; p++; }
+        if (p >= end || !isDigit(*p)) return false;
+        if (*p == '0' && p + 1 < end && isDigit(p[1])) return false;
+        const int64_t limit = (int64_t)numeric_limits<int>::max() + 1;
+        int64_t v = 0;
+        while (p < end && isDigit(*p)) {
+            if (v <= limit) v = v * 10 + (*p - '0');
+            p++;
+        }
+        if (p < end && (*p == '.' || *p == 'e' || *p == 'E')) {
+            p = start;
+            int whole = 0;
+            if (!skipNumber(p, end) || !parseIntegralNumber(start, p, whole)) return false;
+            out.push_back(whole);
+        } else {
+            if (neg) v = -v;
+            if (v > numeric_limits<int>::max() || v < numeric_limits<int>::min()) return false;
+            out.push_back((int)v);
+        }
+
+        skipSpace(p, end);
+        if (p >= end) return false;
+        if (*p == ']') { p++; return true; }
+        if (*p != ',') return false;
+        p++;
+    }
+    return false;
+}
+
+bool parseNumbersObject(const char*& p, const char* end, vector<int>& out) {
+    skipSpace(p, end);
+    if (p >= end || *p != '{') return false;
+    p++;
+    skipSpace(p, end);
+    if (p < end && *p == '}') return false;
+
+    bool found = false;
+    while (true) {
+        skipSpace(p, end);
+        const char* key = p + 1;
+        if (!skipString(p, end)) return false;
+        bool match = (p - key - 1 == 7) && memcmp(key, "numbers", 7) == 0;
+
+        skipSpace(p, end);
+        if (p >= end || *p != ':') return false;
+        p++;
+
+        if (match) {
+            // A repeated key replaces the earlier array
+            out.clear();
+            if (!parseIntArray(p, end, out)) return false;
+            found = true;
+        } else if (!skipValue(p, end, 1)) {
+            return false;
+        }
+
+        skipSpace(p, end);
+        if (p >= end) return false;
+        if (*p == '}') { p++; break; }
+        if (*p != ',') return false;
+        p++;
+    }
+    skipSpace(p, end);
+    return found && p == end;
+}
+
+}
+
+void NumberReverser::reverseInPlace(vector<int>& nums) {
+    reverseInPlace(nums.data(), nums.size());
+}
+
+void NumberReverser::reverseInPlace(int* data, size_t n) {
+    size_t lo = 0;
+#ifdef NUMBER_REVERSER_X86
+    if (hasAvx2()) lo = reverseAvx2(data, n);
+    lo += reverseSse2(data + lo, n - 2 * lo);
+#endif
+    std::reverse(data + lo, data + n - lo);
+}
+
+bool NumberReverser::parseJsonNumbers(const string& body, vector<int>& out) {
+    out.clear();
+    const char* p = body.data();
+    if (parseNumbersObject(p, p + body.size(), out)) return true;
+    out.clear();
+    return false;
+}
+
+bool NumberReverser::fromLittleEndian(const string& body, vector<int>& out) {
+    if (body.size() % 4 != 0) return false;
+    size_t n = body.size() / 4;
+    out.resize(n);
+    const unsigned char* b = (const unsigned char*)body.data();
+    for (size_t i = 0; i < n; i++, b += 4) {
+        out[i] = (int)((uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24);
+    }
+    return true;
+}
+
+string NumberReverser::toLittleEndian(const vector<int>& nums) {
+    string out(nums.size() * 4, '\0');
+    unsigned char* b = (unsigned char*)&out[0];
+    for (size_t i = 0; i < nums.size(); i++, b += 4) {
+        uint32_t v = (uint32_t)nums[i];
+        b[0] = (unsigned char)v;
+        b[1] = (unsigned char)(v >> 8);
+        b[2] = (unsigned char)(v >> 16);
+        b[3] = (unsigned char)(v >> 24);
+    }
+    return out;
+}
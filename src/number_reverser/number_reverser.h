@@ -1,8 +1,25 @@
 #pragma once
 #include <vector>
+#include <string>
+#include <cstddef>
 
 class NumberReverser {
 public:
     // Takes a vector of ints and returns a reversed copy
     static std::vector<int> reverse(const std::vector<int>& nums);
+
+    // Reverses in place without allocating (AVX2/SSE2 when available)
+    static void reverseInPlace(std::vector<int>& nums);
+    static void reverseInPlace(int* data, size_t n);
+
+    // Reads the "numbers" array out of a JSON object body without building
+    // a DOM. Other keys are skipped but still have to be valid JSON.
+    // Elements must be whole numbers that fit an int; 1.0 and 1e3 count.
+    // Returns false, with `out` empty, on malformed input, a missing
+    // "numbers" key or any other element.
+    static bool parseJsonNumbers(const std::string& body, std::vector<int>& out);
+
+    // Little-endian int32 wire format for application/octet-stream bodies
+    static bool fromLittleEndian(const std::string& body, std::vector<int>& out);
+    static std::string toLittleEndian(const std::vector<int>& nums);
 };
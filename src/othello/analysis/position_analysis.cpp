@@ -0,0 +1,140 @@
+#include "position_analysis.h"
+
+#include <climits>
+
+using namespace std;
+
+namespace {
+// Classic square weights: corners are worth most, the squares next to
+// them hand corners to the opponent.
+const int kWeights[8][8] = {
+    {100, -20, 10,  5,  5, 10, -20, 100},
+    {-20, -50, -2, -2, -2, -2, -50, -20},
+    { 10,  -2, -1, -1, -1, -1,  -2,  10},
+    {  5,  -2, -1, -1, -1, -1,  -2,   5},
+    {  5,  -2, -1, -1, -1, -1,  -2,   5},
+    { 10,  -2, -1, -1, -1, -1,  -2,  10},
+    {-20, -50, -2, -2, -2, -2, -50, -20},
+    {100, -20, 10,  5,  5, 10, -20, 100},
+};
+const int kMobilityWeight = 5;
+const int kWinScore = 10000;
+
+vector<pair<int, int>> legalMoves(Board& board, int side) {
+    vector<pair<int, int>> moves;
+    for (int r = 0; r < 8; r++) {
+        for (int c = 0; c < 8; c++) {
+            if (board.at(r, c) == 0 && board.flipVectors(r, c, side, false)) moves.push_back({r, c});
+        }
+    }
+    return moves;
+}
+
+int discDiff(const Board& board, int side) {
+    int diff = 0;
+    for (int r = 0; r < 8; r++) {
+        for (int c = 0; c < 8; c++) diff += board.at(r, c);
+    }
+    return diff * side;
+}
+
+// Negamax with alpha-beta, making and unmaking moves in place.
+int search(Board& board, int side, int depth, int alpha, int beta, bool passed, long long& nodes) {
+    nodes++;
+    if (depth == 0) return PositionAnalyzer::evaluate(board, side);
+
+    auto moves = legalMoves(board, side);
+    if (moves.empty()) {
+        if (passed) {
+            int diff = discDiff(board, side);
+            return diff > 0 ? kWinScore + diff : (diff < 0 ? -kWinScore + diff : 0);
+        }
+        return -search(board, -side, depth - 1, -beta, -alpha, true, nodes);
+    }
+
+    int best = INT_MIN + 1;
+    for (auto& m : moves) {
+        uint64_t flips = board.addPiece(m.first, m.second, side);
+        int score = -search(board, -side, depth - 1, -beta, -alpha, false, nodes);
+        board.undoPiece(m.first, m.second, flips);
+        if (score > best) best = score;
+        if (best > alpha) alpha = best;
+        if (alpha >= beta) break;
+    }
+    return best;
+}
+}
+
+bool PositionAnalyzer::decode(const string& text, vector<vector<int>>& board, int& side) {
+    if (text.size() != 64 && text.size() != 65) return false;
+    board.assign(8, vector<int>(8, 0));
+    for (int i = 0; i < 64; i++) {
+        char ch = text[i];
+        if (ch == 'X' || ch == 'x') board[i / 8][i % 8] = 1;
+        else if (ch == 'O' || ch == 'o') board[i / 8][i % 8] = -1;
+        else if (ch != '-' && ch != '.') return false;
+    }
+    side = 1;
+    if (text.size() == 65) {
+        char ch = text[64];
+        if (ch == 'O' || ch == 'o') side = -1;
+        else if (ch != 'X' && ch != 'x') return false;
+    }
+    return true;
+}
+
+int PositionAnalyzer::evaluate(Board& board, int side) {
+    int score = 0;
+    for (int r = 0; r < 8; r++) {
+        for (int c = 0; c < 8; c++) score += kWeights[r][c] * board.at(r, c);
+    }
+    int mobility = (int)legalMoves(board, 1).size() - (int)legalMoves(board, -1).size();
+    return (score + kMobilityWeight * mobility) * side;
+}
+
+PositionReport PositionAnalyzer::analyze(const string& text, int depth) {
+    PositionReport report;
+    vector<vector<int>> cells;
+    if (!decode(text, cells, report.side)) {
+        report.error = "Expected 64 characters of X, O or - and an optional side to move";
+        return report;
+    }
+    if (depth < 0 || depth > kMaxDepth) {
+        report.error = "depth out of range";
+        return report;
+    }
+
+    Board board;
+    board.setBoard(cells);
+    for (const auto& row : cells) {
+        for (int v : row) {
+            if (v == 1) report.discs_x++;
+            else if (v == -1) report.discs_o++;
+            else report.empty++;
+        }
+    }
+    report.moves = legalMoves(board, report.side);
+    report.eval = evaluate(board, report.side);
+
+    if (depth > 0 && !report.moves.empty()) {
+        int alpha = INT_MIN + 1;
+        for (auto& m : report.moves) {
+            uint64_t flips = board.addPiece(m.first, m.second, report.side);
+            int score = -search(board, -report.side, depth - 1, INT_MIN + 1, -alpha, false, report.nodes);
+            board.undoPiece(m.first, m.second, flips);
+            if (report.best_row < 0 || score > alpha) {
+                alpha = score;
+                report.best_row = m.first;
+                report.best_col = m.second;
+            }
+        }
+        report.score = alpha;
+        report.depth = depth;
+    }
+    report.ok = true;
+    return report;
+}
+
+string PositionAnalyzer::squareName(int row, int col) {
+    return string(1, (char)('a' + col)) + to_string(row + 1);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../board/board.h"
+
+struct PositionReport {
+    bool ok = false;
+    std::string error;
+    int side = 1;                         // side to move
+    std::vector<std::pair<int, int>> moves; // legal moves as (row, col)
+    int discs_x = 0;                      // side 1
+    int discs_o = 0;                      // side -1
+    int empty = 0;
+    int eval = 0;                         // static score for `side`
+    int depth = 0;                        // plies searched; 0 = no search
+    int best_row = -1;                    // best move found, if searched
+    int best_col = -1;
+    int score = 0;                        // search score for `side`
+    long long nodes = 0;
+};
+
+// Scores positions for coaching and replay tools. Stateless, so any number
+// of threads may analyse at once.
+//
+// A position is 64 characters, row by row from the top left: 'X' or 'x'
+// for side 1, 'O' or 'o' for side -1, '-' or '.' for empty. An optional
+// 65th character ('X' or 'O') names the side to move; the default is X.
+class PositionAnalyzer {
+public:
+    static const int kMaxDepth = 4;
+
+    static bool decode(const std::string& text, vector<vector<int>>& board, int& side);
+    // Square weights plus mobility, from `side`'s point of view
+    static int evaluate(Board& board, int side);
+    // Decodes and scores `text`, searching `depth` plies (0 to kMaxDepth)
+    static PositionReport analyze(const std::string& text, int depth);
+    // Algebraic name of a square, e.g. (2, 3) -> "d3"
+    static std::string squareName(int row, int col);
+};
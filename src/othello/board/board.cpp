@@ -2,94 +2,127 @@
 
 using namespace std;
 
-Board::Board() : board(8, vector<int>(8, 0)) {
-    board[3][3] = 1;
-    board[3][4] = -1;
-    board[4][3] = -1;
-    board[4][4] = 1;
+template <int N>
+BasicBoard<N>::BasicBoard() {
+    const int mid = N / 2;
+    cells[(mid - 1) * N + mid - 1] = 1;
+    cells[(mid - 1) * N + mid] = -1;
+    cells[mid * N + mid - 1] = -1;
+    cells[mid * N + mid] = 1;
 }
 
-bool Board::addPiece(int row, int col, int side) {
-    if (validatePlacement(row, col) && flipVectors(row, col, side, true)) {
-        board[row][col] = side;
-        return true;
+template <int N>
+typename BasicBoard<N>::Mask BasicBoard<N>::addPiece(int row, int col, int side) {
+    if (!validatePlacement(row, col)) return 0;
+    flipped = 0;
+    if (!flipVectors(row, col, side, true)) return 0;
+    cells[row * N + col] = side;
+    return flipped;
+}
+
+template <int N>
+void BasicBoard<N>::undoPiece(int row, int col, Mask flips) {
+    cells[row * N + col] = 0;
+    uint64_t low = (uint64_t)flips;
+    while (low) {
+        cells[__builtin_ctzll(low)] *= -1;
+        low &= low - 1;
+    }
+    if constexpr (N * N > 64) {
+        uint64_t high = (uint64_t)(flips >> 64);
+        while (high) {
+            cells[64 + __builtin_ctzll(high)] *= -1;
+            high &= high - 1;
+        }
     }
-    return false;
 }
 
-bool Board::validatePlacement(int row, int col) {
-    if (row < 0 || row > 7 || col < 0 || col > 7) return false;
-    if (board[row][col] != 0) return false;
+template <int N>
+bool BasicBoard<N>::validatePlacement(int row, int col) {
+    if (row < 0 || row >= N || col < 0 || col >= N) return false;
+    if (cells[row * N + col] != 0) return false;
     return true;
 }
 
-bool Board::flipVectors(int row, int col, int side, bool flip) {
+template <int N>
+bool BasicBoard<N>::flipVectors(int row, int col, int side, bool flip) {
+    const int sq = row * N + col;
     bool flipped = false;
-    if (flipVector(row, col, -1, -1, side, flip)) flipped = true;
-    if (flipVector(row, col, -1, 0, side, flip)) flipped = true;
-    if (flipVector(row, col, -1, 1, side, flip)) flipped = true;
-
-    if (flipVector(row, col, 0, -1, side, flip)) flipped = true;
-    if (flipVector(row, col, 0, 1, side, flip)) flipped = true;
-
-    if (flipVector(row, col, 1, -1, side, flip)) flipped = true;
-    if (flipVector(row, col, 1, 0, side, flip)) flipped = true;
-    if (flipVector(row, col, 1, 1, side, flip)) flipped = true;
+    for (int d = 0; d < 8; d++) {
+        if (flipDirection(sq, d, side, flip)) flipped = true;
+    }
     return flipped;
 }
 
-bool Board::flipVector(int row, int col, int vert, int hori, int side, bool flip) {
-    if (!emptySpace(row+vert,col+hori) && board[row+vert][col+hori] == side) return false;
-    return flipRecur(row + vert, col + hori, vert, hori, side, flip);
-}
-
-// recursive
-bool Board::flipRecur(int row, int col, int vert, int hori, int side, bool flip) {
-    if (emptySpace(row, col)) return false;
-    if (board[row][col] == side) return true;
+// Walks from `sq` over the opponent's discs; they are captured if one of
+// `side`'s discs closes the line before the edge.
+template <int N>
+bool BasicBoard<N>::flipDirection(int sq, int dir, int side, bool flip) {
+    const int len = kEdge[sq][dir];
+    const int step = kStep[dir];
+    int run = 0;
+    int s = sq + step;
+    while (run < len && cells[s] == -side) {
+        run++;
+        s += step;
+    }
+    if (run == 0 || run == len || cells[s] != side) return false;
 
-    if (flipRecur(row + vert, col + hori, vert, hori, side, flip)) {
-        if (flip) board[row][col] *= -1;
-        return true;
+    if (flip) {
+        for (int i = 1; i <= run; i++) {
+            int t = sq + i * step;
+            cells[t] = side;
+            flipped |= (Mask)1 << t;
+        }
     }
-    return false;
+    return true;
 }
 
-bool Board::emptySpace(int row, int col) {
-    if (row < 0 || row > 7 || col < 0 || col > 7) return true;
-    if (board[row][col] == 0) return true;
+template <int N>
+bool BasicBoard<N>::emptySpace(int row, int col) {
+    if (row < 0 || row >= N || col < 0 || col >= N) return true;
+    if (cells[row * N + col] == 0) return true;
     return false;
 }
 
-const vector<vector<int>>& Board::getBoard() const {
-    return board;
+template <int N>
+vector<vector<int>> BasicBoard<N>::getBoard() const {
+    vector<vector<int>> out(N, vector<int>(N));
+    for (int i = 0; i < N * N; i++) out[i / N][i % N] = cells[i];
+    return out;
 }
 
-void Board::setBoard(const vector<vector<int>>& next) {
-    board = next;
+template <int N>
+void BasicBoard<N>::setBoard(const vector<vector<int>>& next) {
+    for (int i = 0; i < N * N; i++) cells[i] = (int8_t)next[i / N][i % N];
 }
 
-bool Board::anyMoves(int side) {
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            if (board[i][j] == 0 && flipVectors(i, j, side, false)) return true;
+template <int N>
+bool BasicBoard<N>::anyMoves(int side) {
+    for (int sq = 0; sq < N * N; sq++) {
+        if (cells[sq] != 0) continue;
+        for (int d = 0; d < 8; d++) {
+            if (flipDirection(sq, d, side, false)) return true;
         }
     }
     return false;
 }
 
-int Board::calcWinner() {
+template <int N>
+int BasicBoard<N>::calcWinner() {
     int firstNum = 0;
     int secondNum = 0;
 
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            if (board[i][j] == -1) firstNum++;
-            else if (board[i][j] == 1) secondNum++;
-        }
+    for (int v : cells) {
+        if (v == -1) firstNum++;
+        else if (v == 1) secondNum++;
     }
 
     if (firstNum > secondNum) return -1;
     else if (secondNum > firstNum) return 1;
     return 0;
 }
+
+template class BasicBoard<6>;
+template class BasicBoard<8>;
+template class BasicBoard<10>;
@@ -1,22 +1,103 @@
 #pragma once
+#include <array>
+#include <cstdint>
+#include <type_traits>
 #include <vector>
 
 using namespace std;
 
-class Board {
+// Games can be played on 6x6, 8x8 or 10x10. Each size is its own
+// instantiation of BasicBoard, with the geometry fixed at compile time.
+constexpr int kBoardSizes[] = {6, 8, 10};
+constexpr bool is_board_size(int n) { return n == 6 || n == 8 || n == 10; }
+
+namespace board_geometry {
+// The eight directions as (row, col) steps
+constexpr int kDirRow[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+constexpr int kDirCol[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+
+// Squares between each square and the edge in each direction, so walking
+// a ray needs no bounds checks.
+template <int N>
+constexpr array<array<uint8_t, 8>, N * N> edgeDistances() {
+    array<array<uint8_t, 8>, N * N> out{};
+    for (int sq = 0; sq < N * N; sq++) {
+        for (int d = 0; d < 8; d++) {
+            int r = sq / N + kDirRow[d], c = sq % N + kDirCol[d];
+            uint8_t n = 0;
+            while (r >= 0 && r < N && c >= 0 && c < N) {
+                n++;
+                r += kDirRow[d];
+                c += kDirCol[d];
+            }
+            out[sq][d] = n;
+        }
+    }
+    return out;
+}
+}
+
+template <int N>
+class BasicBoard {
+    static_assert(is_board_size(N), "unsupported board size");
+public:
+    static constexpr int kSize = N;
+    // One bit per square, bit row*N+col
+    using Mask = conditional_t<(N * N <= 64), uint64_t, unsigned __int128>;
+
 private:
-    vector<vector<int>> board;
+    // Step between neighbouring squares in each direction
+    static constexpr int kStep[8] = {-N - 1, -N, -N + 1, -1, 1, N - 1, N, N + 1};
+    static constexpr auto kEdge = board_geometry::edgeDistances<N>();
+
+    array<int8_t, N * N> cells{}; // row by row
+    Mask flipped = 0;             // discs flipped by the addPiece in progress
+
+    bool flipDirection(int sq, int dir, int side, bool flip);
 public:
-    Board();
+    BasicBoard();
 
-    bool addPiece(int row, int col, int side);
+    // Returns the flipped discs as a mask, or 0 if the move is illegal; a
+    // legal move always flips at least one disc.
+    Mask addPiece(int row, int col, int side);
+    // Takes back addPiece(row, col, ...) given the mask it returned
+    void undoPiece(int row, int col, Mask flips);
     bool validatePlacement(int row, int col);
     bool flipVectors(int row, int col, int side, bool flip);
-    bool flipVector(int row, int col, int vert, int hori, int side, bool flip);
-    bool flipRecur(int row, int col, int vert, int hori, int side, bool flip);
     bool emptySpace(int row, int col);
-    const vector<vector<int>>& getBoard() const;
+    int at(int row, int col) const { return cells[row * N + col]; }
+    vector<vector<int>> getBoard() const;
+    // `next` must be N rows of N
     void setBoard(const vector<vector<int>>& next);
     bool anyMoves(int side);
     int calcWinner();
 };
+
+extern template class BasicBoard<6>;
+extern template class BasicBoard<8>;
+extern template class BasicBoard<10>;
+
+using Board = BasicBoard<8>;
+
+template <int N, typename F>
+bool with_board_of(const vector<vector<int>>& cells, F& f) {
+    for (const auto& row : cells) {
+        if ((int)row.size() != N) return false;
+    }
+    BasicBoard<N> board;
+    board.setBoard(cells);
+    f(board);
+    return true;
+}
+
+// Loads `cells` into a board of their size and calls f(board). Returns
+// false, without calling f, unless they form a square of a supported size.
+template <typename F>
+bool with_board(const vector<vector<int>>& cells, F&& f) {
+    switch (cells.size()) {
+        case 6: return with_board_of<6>(cells, f);
+        case 8: return with_board_of<8>(cells, f);
+        case 10: return with_board_of<10>(cells, f);
+        default: return false;
+    }
+}
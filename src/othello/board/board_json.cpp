@@ -0,0 +1,106 @@
+#include "board_json.h"
+#include <crow.h>
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <sstream>
+#include "board.h"
+#include "tracing.h"
+
+std::vector<std::vector<int>> initial_board(int size) {
+    std::vector<std::vector<int>> b(size, std::vector<int>(size, 0));
+    int mid = size / 2;
+    b[mid - 1][mid - 1] = 1;
+    b[mid - 1][mid] = -1;
+    b[mid][mid - 1] = -1;
+    b[mid][mid] = 1;
+    return b;
+}
+
+std::string board_to_json(const std::vector<std::vector<int>>& b) {
+    TraceSpan span("board.encode");
+    std::ostringstream oss;
+    oss << "[";
+    for (size_t r = 0; r < b.size(); r++) {
+        if (r) oss << ",";
+        oss << "[";
+        for (size_t c = 0; c < b[r].size(); c++) {
+            if (c) oss << ",";
+            oss << b[r][c];
+        }
+        oss << "]";
+    }
+    oss << "]";
+    return oss.str();
+}
+
+std::vector<std::vector<int>> board_from_json(const std::string& s) {
+    TraceSpan span("board.decode");
+    std::vector<std::vector<int>> out;
+    auto j = crow::json::load(s);
+    if (!j || j.t() != crow::json::type::List) return out;
+    out.resize(j.size());
+    for (size_t r = 0; r < j.size(); r++) {
+        out[r].resize(j[r].size());
+        for (size_t c = 0; c < j[r].size(); c++) {
+            out[r][c] = j[r][c].i();
+        }
+    }
+    return out;
+}
+
+std::string move_log_entry(int square, FlipMask flips) {
+    if (square < 0) return "pass ";
+    char buf[48];
+    unsigned long long high = (unsigned long long)(flips >> 64);
+    unsigned long long low = (unsigned long long)flips;
+    if (high) std::snprintf(buf, sizeof buf, "%d:%llx%016llx ", square, high, low);
+    else std::snprintf(buf, sizeof buf, "%d:%llx ", square, low);
+    return buf;
+}
+
+bool parse_move_log(const std::string& log, std::vector<LoggedMove>& out) {
+    out.clear();
+    const char* p = log.data();
+    const char* end = p + log.size();
+    while (p < end) {
+        const char* sp = std::find(p, end, ' ');
+        if (sp == end) return false;
+        if (sp - p == 4 && std::string(p, 4) == "pass") {
+            out.push_back({-1, 0});
+        } else {
+            LoggedMove m{-1, 0};
+            auto r = std::from_chars(p, sp, m.square);
+            if (r.ec != std::errc() || *r.ptr != ':' || m.square < 0 || m.square >= 128) return false;
+            const char* hex = r.ptr + 1;
+            if (hex == sp || sp - hex > 32) return false;
+            for (; hex < sp; hex++) {
+                int digit;
+                if (*hex >= '0' && *hex <= '9') digit = *hex - '0';
+                else if (*hex >= 'a' && *hex <= 'f') digit = *hex - 'a' + 10;
+                else return false;
+                m.flips = (m.flips << 4) | (FlipMask)digit;
+            }
+            if (!m.flips) return false;
+            out.push_back(m);
+        }
+        p = sp + 1;
+    }
+    return true;
+}
+
+bool log_is_complete(const std::vector<std::vector<int>>& board, const std::vector<LoggedMove>& log) {
+    int size = (int)board.size();
+    if (!is_board_size(size)) return false;
+    bool complete = false;
+    with_board(initial_board(size), [&](auto& replay) {
+        int side = 1;
+        for (const LoggedMove& m : log) {
+            if (m.square >= size * size) return;
+            if (m.square >= 0 && replay.addPiece(m.square / size, m.square % size, side) != m.flips) return;
+            side = -side;
+        }
+        complete = replay.getBoard() == board;
+    });
+    return complete;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Boards are stored in the games table as JSON arrays of rows,
+// 1 = player1, -1 = player2, 0 = empty.
+// Starting position for a size x size game (size even)
+std::vector<std::vector<int>> initial_board(int size = 8);
+std::string board_to_json(const std::vector<std::vector<int>>& b);
+// Returns an empty board on malformed input
+std::vector<std::vector<int>> board_from_json(const std::string& s);
+
+// Games also keep a move log with one entry per turn, "<square>:<flip
+// mask in hex> " for a move (square = row*size+col, as are the mask bits)
+// or "pass " for a pass. Turns alternate, so entry k was made by side 1
+// when k is even, and a move can be unmade from its mask without storing
+// earlier boards.
+using FlipMask = unsigned __int128; // wide enough for a 10x10 board
+struct LoggedMove {
+    int square; // -1 for a pass
+    FlipMask flips;
+};
+std::string move_log_entry(int square, FlipMask flips);
+// Returns false on malformed input
+bool parse_move_log(const std::string& log, std::vector<LoggedMove>& out);
+// Whether `log` is the whole game that led to `board`: replayed from the
+// start position, each move flips what it says and the last one leaves
+// `board`. Games from before the log existed have none or only its tail.
+bool log_is_complete(const std::vector<std::vector<int>>& board, const std::vector<LoggedMove>& log);
@@ -17,9 +17,29 @@ void Othello::setCur(Player* cur) {
 
 bool Othello::placePiece(int row, int col) {
     if (!cur) return false;
-    bool ok = cur->placePiece(row, col);
-    if (ok) nextTurn();
-    return ok;
+    Board::Mask flips = cur->placePiece(row, col);
+    if (!flips) return false;
+    history.push_back({row, col, getCurrentSide(), flips});
+    nextTurn();
+    return true;
+}
+
+void Othello::pass() {
+    history.push_back({-1, -1, getCurrentSide(), 0});
+    nextTurn();
+}
+
+bool Othello::undo() {
+    if (history.empty()) return false;
+    Move m = history.back();
+    history.pop_back();
+    if (m.row >= 0) board.undoPiece(m.row, m.col, m.flips);
+    cur = (m.side == 1) ? &p1 : &p2;
+    return true;
+}
+
+const vector<Othello::Move>& Othello::getHistory() const {
+    return history;
 }
 
 const Board& Othello::getBoard() const {
@@ -4,12 +4,23 @@
 #include "pieces/pieces.h"
 #include "players/player.h"
 
+#include <cstdint>
+#include <vector>
+
 class Othello {
+public:
+    struct Move {
+        int row; // -1 for a pass
+        int col;
+        int side;
+        Board::Mask flips;
+    };
 private:
     Board board;
     Player p1;
     Player p2;
     Player* cur;
+    vector<Move> history;
 public:
     Othello();
     // Takes a vector of ints and returns a reversed copy
@@ -17,6 +28,11 @@ public:
     void nextTurn();
     void setCur(Player* cur);
     bool placePiece(int row, int col);
+    void pass();
+    // Unmakes the last move or pass from the move stack, without copying
+    // the board. Returns false if there is nothing to undo.
+    bool undo();
+    const vector<Move>& getHistory() const;
     const Board& getBoard() const;
     int getCurrentSide() const;
 };
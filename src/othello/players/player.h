@@ -8,5 +8,6 @@ private:
     int side;
 public:
     Player(Board& board, int side);
-    bool placePiece(int row, int col);
+    // Returns the flip mask from Board::addPiece; 0 if illegal
+    Board::Mask placePiece(int row, int col);
 };
@@ -0,0 +1,363 @@
+#include "position_index.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "board/board.h"
+
+using namespace std;
+
+namespace {
+const char kMagic[8] = {'O', 'T', 'H', 'P', 'O', 'S', '0', '1'};
+const int kMoveSlots = 11;
+const uint8_t kPassSquare = 255;
+const uint64_t kInitialCapacity = 1 << 16;
+
+struct Header {
+    char magic[8];
+    uint64_t capacity; // entries, a power of two
+    uint64_t used;
+};
+
+// The keys are derived from a fixed seed: hashes are persisted and shown
+// to clients, so they must never change between builds.
+struct ZobristKeys {
+    uint64_t squares[128][2]; // [square][0 for side 1, 1 for side -1]
+    uint64_t sizes[11];
+    uint64_t o_to_move;
+
+    ZobristKeys() {
+        uint64_t state = 0x6f7468656c6c6f21ULL;
+        auto next = [&state] {
+            // splitmix64
+            uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        };
+        for (auto& sq : squares) {
+            sq[0] = next();
+            sq[1] = next();
+        }
+        for (auto& k : sizes) k = next();
+        o_to_move = next();
+    }
+};
+
+const ZobristKeys& keys() {
+    static const ZobristKeys k;
+    return k;
+}
+
+// flock() for the length of an operation when processes share the file;
+// a no-op for fd -1
+struct FileLock {
+    int fd;
+    FileLock(int fd, int op) : fd(fd) {
+        while (fd >= 0 && flock(fd, op) != 0 && errno == EINTR) {}
+    }
+    ~FileLock() {
+        if (fd >= 0) flock(fd, LOCK_UN);
+    }
+};
+}
+
+struct PositionIndex::Entry {
+    uint64_t key; // 0 = empty slot
+    uint32_t x_wins;
+    uint32_t o_wins;
+    uint32_t draws;
+    uint8_t size;
+    uint8_t squares[kMoveSlots]; // meaningful where counts[i] > 0
+    uint32_t counts[kMoveSlots];
+    uint32_t other_moves;
+};
+
+PositionIndex::~PositionIndex() {
+    close();
+}
+
+void PositionIndex::unmap() {
+    if (map) {
+        msync(map, map_len, MS_SYNC);
+        munmap(map, map_len);
+    }
+    if (fd >= 0) ::close(fd);
+    map = nullptr;
+    map_len = 0;
+    fd = -1;
+}
+
+void PositionIndex::close() {
+    unmap();
+    if (lock_fd >= 0) ::close(lock_fd);
+    lock_fd = -1;
+}
+
+bool PositionIndex::open(const string& file, bool& created, bool shared) {
+    lock_guard<mutex> lock(mtx);
+    close();
+    path = file;
+    if (shared) {
+        lock_fd = ::open((path + ".lock").c_str(), O_RDWR | O_CREAT, 0644);
+        if (lock_fd < 0) return false;
+    }
+    FileLock file_lock(lock_fd, LOCK_EX);
+    if (!mapFile(created)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool PositionIndex::mapFile(bool& created) {
+    created = false;
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        unmap();
+        return false;
+    }
+
+    size_t len = (size_t)st.st_size;
+    if (len == 0) {
+        created = true;
+        len = sizeof(Header) + kInitialCapacity * sizeof(Entry);
+        if (ftruncate(fd, (off_t)len) != 0) {
+            unmap();
+            return false;
+        }
+    }
+    void* m = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED) {
+        unmap();
+        return false;
+    }
+    map = m;
+    map_len = len;
+
+    Header* h = (Header*)map;
+    if (created) {
+        memcpy(h->magic, kMagic, sizeof kMagic);
+        h->capacity = kInitialCapacity;
+        h->used = 0;
+    }
+    if (memcmp(h->magic, kMagic, sizeof kMagic) != 0 || (h->capacity & (h->capacity - 1)) != 0
+        || len != sizeof(Header) + h->capacity * sizeof(Entry)) {
+        unmap();
+        return false;
+    }
+    return true;
+}
+
+// Another process may have grown the table into a new file since we last
+// looked; if so, map that one instead.
+bool PositionIndex::current() {
+    if (!map) return false;
+    if (lock_fd < 0) return true;
+    struct stat on_disk, mapped;
+    if (stat(path.c_str(), &on_disk) != 0 || fstat(fd, &mapped) != 0) return false;
+    if (on_disk.st_ino == mapped.st_ino && on_disk.st_dev == mapped.st_dev) return true;
+    unmap();
+    bool created;
+    return mapFile(created);
+}
+
+PositionIndex::Entry* PositionIndex::probe(void* map, uint64_t key) {
+    Header* h = (Header*)map;
+    auto* table = (Entry*)(h + 1);
+    uint64_t mask = h->capacity - 1;
+    for (uint64_t i = key & mask;; i = (i + 1) & mask) {
+        if (table[i].key == key || table[i].key == 0) return &table[i];
+    }
+}
+
+// Rehashes into a table of `capacity` entries, built in a new file that
+// then replaces the old one.
+bool PositionIndex::remap(size_t capacity) {
+    string tmp = path + ".tmp";
+    int nfd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (nfd < 0) return false;
+    size_t len = sizeof(Header) + capacity * sizeof(Entry);
+    void* m = MAP_FAILED;
+    if (ftruncate(nfd, (off_t)len) == 0) m = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, nfd, 0);
+    if (m == MAP_FAILED) {
+        ::close(nfd);
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    Header* nh = (Header*)m;
+    memcpy(nh->magic, kMagic, sizeof kMagic);
+    nh->capacity = capacity;
+    nh->used = 0;
+    Header* h = (Header*)map;
+    auto* table = (Entry*)(h + 1);
+    for (uint64_t i = 0; i < h->capacity; i++) {
+        if (!table[i].key) continue;
+        *probe(m, table[i].key) = table[i];
+        nh->used++;
+    }
+
+    msync(m, len, MS_SYNC);
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        munmap(m, len);
+        ::close(nfd);
+        unlink(tmp.c_str());
+        return false;
+    }
+    munmap(map, map_len);
+    ::close(fd);
+    map = m;
+    map_len = len;
+    fd = nfd;
+    return true;
+}
+
+PositionIndex::Entry* PositionIndex::find(uint64_t hash, bool insert) {
+    if (!map) return nullptr;
+    uint64_t key = hash ? hash : 1;
+    Entry* e = probe(map, key);
+    if (e->key == key) return e;
+    if (!insert) return nullptr;
+
+    Header* h = (Header*)map;
+    // Keep the load under 70% so probe runs stay short
+    if ((h->used + 1) * 10 > h->capacity * 7) {
+        if (!remap(h->capacity * 2)) return nullptr;
+        h = (Header*)map;
+        e = probe(map, key);
+    }
+    memset(e, 0, sizeof *e);
+    e->key = key;
+    h->used++;
+    return e;
+}
+
+void PositionIndex::countMove(Entry* e, int square, int delta) {
+    uint8_t sq = square < 0 ? kPassSquare : (uint8_t)square;
+    int free_slot = -1;
+    for (int i = 0; i < kMoveSlots; i++) {
+        if (e->counts[i] && e->squares[i] == sq) {
+            e->counts[i] = (delta < 0 && e->counts[i] < (uint32_t)-delta) ? 0 : e->counts[i] + delta;
+            return;
+        }
+        if (!e->counts[i] && free_slot < 0) free_slot = i;
+    }
+    if (delta > 0 && free_slot >= 0) {
+        e->squares[free_slot] = sq;
+        e->counts[free_slot] = (uint32_t)delta;
+    } else {
+        e->other_moves = (delta < 0 && e->other_moves < (uint32_t)-delta) ? 0 : e->other_moves + delta;
+    }
+}
+
+void PositionIndex::recordMove(uint64_t hash, int size, int square, int delta) {
+    lock_guard<mutex> lock(mtx);
+    FileLock file_lock(lock_fd, LOCK_EX);
+    if (!current()) return;
+    Entry* e = find(hash, delta > 0);
+    if (!e) return;
+    e->size = (uint8_t)size;
+    countMove(e, square, delta);
+}
+
+void PositionIndex::walk(int size, const vector<LoggedMove>& log, bool count_moves, int result) {
+    if (!is_board_size(size)) return;
+    lock_guard<mutex> lock(mtx);
+    FileLock file_lock(lock_fd, LOCK_EX);
+    if (!current()) return;
+    const bool credit = result == 1 || result == -1 || result == 0;
+    uint64_t hash = hashBoard(initial_board(size), 1);
+    int side = 1;
+    for (size_t i = 0;; i++) {
+        bool last = i == log.size();
+        if (last && !credit) break;
+        Entry* e = find(hash, true);
+        if (!e) return;
+        e->size = (uint8_t)size;
+        if (result == 1) e->x_wins++;
+        else if (result == -1) e->o_wins++;
+        else if (result == 0) e->draws++;
+        if (last) break;
+
+        const LoggedMove& m = log[i];
+        if (count_moves) countMove(e, m.square, 1);
+        hash = applyMove(hash, m.square, m.flips, side);
+        side = -side;
+    }
+}
+
+void PositionIndex::recordResult(int size, const vector<LoggedMove>& log, int winner_side) {
+    walk(size, log, false, winner_side);
+}
+
+void PositionIndex::recordMoves(int size, const vector<LoggedMove>& log) {
+    walk(size, log, true, 2);
+}
+
+PositionIndex::Stats PositionIndex::lookup(uint64_t hash) {
+    lock_guard<mutex> lock(mtx);
+    Stats stats;
+    FileLock file_lock(lock_fd, LOCK_SH);
+    if (!current()) return stats;
+    Entry* e = find(hash, false);
+    if (!e) return stats;
+    stats.found = true;
+    stats.size = e->size;
+    stats.x_wins = e->x_wins;
+    stats.o_wins = e->o_wins;
+    stats.draws = e->draws;
+    stats.other_moves = e->other_moves;
+    for (int i = 0; i < kMoveSlots; i++) {
+        if (e->counts[i]) stats.moves.push_back({e->squares[i] == kPassSquare ? kPass : e->squares[i], e->counts[i]});
+    }
+    sort(stats.moves.begin(), stats.moves.end(), [](const MoveStat& a, const MoveStat& b) { return a.count > b.count; });
+    return stats;
+}
+
+size_t PositionIndex::positions() {
+    lock_guard<mutex> lock(mtx);
+    FileLock file_lock(lock_fd, LOCK_SH);
+    return current() ? (size_t)((Header*)map)->used : 0;
+}
+
+uint64_t PositionIndex::hashBoard(const vector<vector<int>>& cells, int side) {
+    const ZobristKeys& k = keys();
+    int n = (int)cells.size();
+    uint64_t hash = n < 11 ? k.sizes[n] : 0;
+    for (int r = 0; r < n; r++) {
+        for (int c = 0; c < (int)cells[r].size() && r * n + c < 128; c++) {
+            if (cells[r][c]) hash ^= k.squares[r * n + c][cells[r][c] == 1 ? 0 : 1];
+        }
+    }
+    if (side == -1) hash ^= k.o_to_move;
+    return hash;
+}
+
+uint64_t PositionIndex::applyMove(uint64_t hash, int square, FlipMask flips, int side) {
+    const ZobristKeys& k = keys();
+    hash ^= k.o_to_move;
+    if (square < 0) return hash;
+    hash ^= k.squares[square][side == 1 ? 0 : 1];
+    // A flipped disc swaps colour: out with one key, in with the other
+    uint64_t low = (uint64_t)flips, high = (uint64_t)(flips >> 64);
+    while (low) {
+        int sq = __builtin_ctzll(low);
+        hash ^= k.squares[sq][0] ^ k.squares[sq][1];
+        low &= low - 1;
+    }
+    while (high) {
+        int sq = 64 + __builtin_ctzll(high);
+        hash ^= k.squares[sq][0] ^ k.squares[sq][1];
+        high &= high - 1;
+    }
+    return hash;
+}
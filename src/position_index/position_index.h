@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "board/board_json.h"
+
+// Every position reached in any game, keyed by Zobrist hash, with how
+// often each next move was played from it and how the games through it
+// ended (a position can't recur within one game, so each game counts
+// once).
+//
+// The table uses open addressing with linear probing over fixed-size
+// entries in a memory-mapped file, so it survives restarts without a
+// rebuild and the OS writes it back in the background. A crash can lose
+// or tear the last few updates; the counts are statistics, not records.
+// Thread-safe. Processes may share the file if all open it `shared`: each
+// operation then holds an flock on "<path>.lock" and checks whether
+// another process has grown the table into a new file.
+class PositionIndex {
+public:
+    static const int kPass = -1;
+
+    struct MoveStat {
+        int square; // row*size+col, or kPass
+        uint32_t count;
+    };
+    struct Stats {
+        bool found = false;
+        int size = 0;
+        uint32_t x_wins = 0; // side 1
+        uint32_t o_wins = 0; // side -1
+        uint32_t draws = 0;
+        std::vector<MoveStat> moves; // most played first
+        uint32_t other_moves = 0;    // played moves that didn't fit a slot
+    };
+
+    PositionIndex() = default;
+    ~PositionIndex();
+    PositionIndex(const PositionIndex&) = delete;
+    PositionIndex& operator=(const PositionIndex&) = delete;
+
+    // Maps `path`, creating it if needed. Returns false on I/O error or a
+    // file that isn't an index; `created` says whether it started empty.
+    bool open(const std::string& path, bool& created, bool shared = false);
+
+    // Counts `square` as played from the position `hash` (negative `delta`
+    // takes it back, for takebacks)
+    void recordMove(uint64_t hash, int size, int square, int delta = 1);
+    // Walks a finished game's log from the start position, crediting the
+    // result to every position on the way; `winner_side` 0 is a draw
+    void recordResult(int size, const std::vector<LoggedMove>& log, int winner_side);
+    // Counts every move in `log`, for filling a new index from old games
+    void recordMoves(int size, const std::vector<LoggedMove>& log);
+    Stats lookup(uint64_t hash);
+    size_t positions();
+
+    // Zobrist hash of `cells` with `side` to move
+    static uint64_t hashBoard(const std::vector<std::vector<int>>& cells, int side);
+    // Hash after `side` plays `square` flipping `flips`, or passes with
+    // square kPass, in the position `hash`
+    static uint64_t applyMove(uint64_t hash, int square, FlipMask flips, int side);
+
+private:
+    struct Entry;
+
+    std::mutex mtx;
+    std::string path;
+    int lock_fd = -1;
+    int fd = -1;
+    void* map = nullptr;
+    size_t map_len = 0;
+
+    // The slot holding `key` in the table at `map`, or the empty slot
+    // where it belongs
+    static Entry* probe(void* map, uint64_t key);
+    Entry* find(uint64_t hash, bool insert);
+    void countMove(Entry* e, int square, int delta);
+    // result: 1, -1 or 0 to credit, anything else to leave results alone
+    void walk(int size, const std::vector<LoggedMove>& log, bool count_moves, int result);
+    bool mapFile(bool& created);
+    bool current();
+    bool remap(size_t capacity);
+    void unmap();
+    void close();
+};
@@ -0,0 +1,289 @@
+#include "prefork.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+using namespace std;
+
+namespace {
+const size_t kMaxDatagram = 64 * 1024;
+
+volatile sig_atomic_t stop_signal = 0;
+volatile sig_atomic_t child_exited = 0;
+
+void onStop(int sig) { stop_signal = sig; }
+void onChild(int) { child_exited = 1; }
+
+struct Worker {
+    pid_t pid = -1;
+    int fd = -1;
+    chrono::steady_clock::time_point started;
+    chrono::steady_clock::time_point restart_at;
+    chrono::seconds backoff{0};
+};
+
+bool sendTo(int fd, const string& datagram) {
+    return ::send(fd, datagram.data(), datagram.size(), MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t)datagram.size();
+}
+
+pid_t spawn(int index, vector<Worker>& workers, const function<int(int, int)>& run_worker) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, pair) != 0) return -1;
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(pair[0]);
+        close(pair[1]);
+        return -1;
+    }
+    if (pid == 0) {
+#ifdef __linux__
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGCHLD, SIG_DFL);
+        close(pair[0]);
+        for (const Worker& w : workers) {
+            if (w.fd >= 0) close(w.fd);
+        }
+        _exit(run_worker(index, pair[1]));
+    }
+    close(pair[1]);
+    Worker& w = workers[index];
+    w.pid = pid;
+    w.fd = pair[0];
+    w.started = chrono::steady_clock::now();
+    return pid;
+}
+}
+
+int Supervisor::run(int count, const function<int(int, int)>& run_worker, const Hooks& hooks) {
+#ifndef __linux__
+    fprintf(stderr, "WORKERS needs Linux (SO_REUSEPORT load balancing)\n");
+    return 1;
+#endif
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = onStop; // no SA_RESTART, so poll() wakes up
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    sa.sa_handler = onChild;
+    sigaction(SIGCHLD, &sa, nullptr);
+
+    vector<Worker> workers(count);
+    for (int i = 0; i < count; i++) {
+        if (spawn(i, workers, run_worker) < 0) perror("fork");
+    }
+    fprintf(stderr, "Supervisor %d started %d workers\n", (int)getpid(), count);
+
+    vector<char> buf(kMaxDatagram);
+    size_t next_worker = 0;
+    auto next_tick = chrono::steady_clock::now();
+    while (!stop_signal) {
+        vector<pollfd> fds;
+        vector<int> owners;
+        for (int i = 0; i < count; i++) {
+            if (workers[i].fd < 0) continue;
+            fds.push_back({workers[i].fd, POLLIN, 0});
+            owners.push_back(i);
+        }
+        poll(fds.data(), fds.size(), 250);
+
+        for (size_t k = 0; k < fds.size(); k++) {
+            if (!(fds[k].revents & POLLIN)) continue;
+            int from = owners[k];
+            ssize_t n;
+            while ((n = recv(workers[from].fd, buf.data(), buf.size(), MSG_DONTWAIT)) > 0) {
+                string msg(buf.data(), (size_t)n);
+                if (msg.compare(0, 2, "b ") == 0) {
+                    string relay = "m " + msg.substr(2);
+                    for (int i = 0; i < count; i++) {
+                        if (i != from && workers[i].fd >= 0) sendTo(workers[i].fd, relay);
+                    }
+                } else if (msg.compare(0, 2, "c ") == 0 && hooks.on_call) {
+                    size_t sp = msg.find(' ', 2);
+                    if (sp == string::npos) continue;
+                    string seq = msg.substr(2, sp - 2);
+                    string reply = hooks.on_call(msg.substr(sp + 1));
+                    if (seq != "0") sendTo(workers[from].fd, "r " + seq + " " + reply);
+                }
+            }
+        }
+
+        auto now = chrono::steady_clock::now();
+        if (now >= next_tick) {
+            next_tick = now + chrono::milliseconds(250);
+            if (hooks.on_tick) {
+                for (const string& msg : hooks.on_tick()) {
+                    for (int tries = 0; tries < count; tries++) {
+                        Worker& w = workers[next_worker++ % count];
+                        if (w.fd >= 0 && sendTo(w.fd, "m " + msg)) break;
+                    }
+                }
+            }
+        }
+
+        if (child_exited) {
+            child_exited = 0;
+            int status;
+            pid_t pid;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+                for (Worker& w : workers) {
+                    if (w.pid != pid) continue;
+                    close(w.fd);
+                    w.fd = -1;
+                    w.pid = -1;
+                    // A worker that dies within 10s of starting is likely to
+                    // again; back off up to 30s between attempts.
+                    bool young = now - w.started < chrono::seconds(10);
+                    w.backoff = young ? min(chrono::seconds(30), max(chrono::seconds(1), w.backoff * 2)) : chrono::seconds(0);
+                    w.restart_at = now + w.backoff;
+                    if (WIFSIGNALED(status)) {
+                        fprintf(stderr, "Worker %d killed by signal %d, restarting in %llds\n", (int)pid, WTERMSIG(status), (long long)w.backoff.count());
+                    } else {
+                        fprintf(stderr, "Worker %d exited with %d, restarting in %llds\n", (int)pid, WEXITSTATUS(status), (long long)w.backoff.count());
+                    }
+                }
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            if (workers[i].pid < 0 && now >= workers[i].restart_at && spawn(i, workers, run_worker) < 0) {
+                workers[i].restart_at = now + chrono::seconds(1);
+            }
+        }
+    }
+
+    // Pass the signal on and give workers 10s to finish their requests
+    for (const Worker& w : workers) {
+        if (w.pid > 0) kill(w.pid, SIGTERM);
+    }
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+    int alive = 0;
+    for (const Worker& w : workers) alive += w.pid > 0;
+    while (alive > 0) {
+        pid_t pid = waitpid(-1, nullptr, WNOHANG);
+        if (pid > 0) {
+            alive--;
+            continue;
+        }
+        if (pid < 0 && errno == ECHILD) break;
+        if (chrono::steady_clock::now() >= deadline) {
+            for (const Worker& w : workers) {
+                if (w.pid > 0) kill(w.pid, SIGKILL);
+            }
+            deadline = chrono::steady_clock::time_point::max();
+        }
+        this_thread::sleep_for(chrono::milliseconds(50));
+    }
+    for (const Worker& w : workers) {
+        if (w.fd >= 0) close(w.fd);
+    }
+    return 0;
+}
+
+WorkerChannel::WorkerChannel(int fd) : fd(fd) {}
+
+WorkerChannel::~WorkerChannel() {
+    stop();
+    close(fd);
+}
+
+void WorkerChannel::start(Handler on_message) {
+    running = true;
+    reader = thread([this, on_message] { readLoop(on_message); });
+}
+
+void WorkerChannel::stop() {
+    running = false;
+    if (reader.joinable()) reader.join();
+}
+
+void WorkerChannel::readLoop(Handler on_message) {
+    vector<char> buf(kMaxDatagram);
+    while (running) {
+        pollfd p{fd, POLLIN, 0};
+        if (poll(&p, 1, 200) <= 0) continue;
+        ssize_t n = recv(fd, buf.data(), buf.size(), MSG_DONTWAIT);
+        if (n <= 0) continue;
+        string msg(buf.data(), (size_t)n);
+        if (msg.compare(0, 2, "m ") == 0) {
+            on_message(msg.substr(2));
+        } else if (msg.compare(0, 2, "r ") == 0) {
+            uint64_t seq = strtoull(msg.c_str() + 2, nullptr, 10);
+            size_t sp = msg.find(' ', 2);
+            lock_guard<mutex> lock(mtx);
+            auto it = pending.find(seq);
+            if (it == pending.end()) continue; // timed out
+            it->second->done = true;
+            it->second->reply = sp == string::npos ? "" : msg.substr(sp + 1);
+            cv.notify_all();
+        }
+    }
+}
+
+bool WorkerChannel::send(const string& datagram) {
+    // Blocking, so a busy supervisor slows callers rather than losing
+    // their messages
+    return ::send(fd, datagram.data(), datagram.size(), MSG_NOSIGNAL) == (ssize_t)datagram.size();
+}
+
+void WorkerChannel::broadcast(const string& message) {
+    send("b " + message);
+}
+
+void WorkerChannel::tell(const string& request) {
+    send("c 0 " + request);
+}
+
+optional<string> WorkerChannel::call(const string& request, chrono::milliseconds timeout) {
+    Pending slot;
+    uint64_t seq;
+    {
+        lock_guard<mutex> lock(mtx);
+        seq = next_seq++;
+        pending[seq] = &slot;
+    }
+    bool sent = send("c " + to_string(seq) + " " + request);
+    unique_lock<mutex> lock(mtx);
+    if (sent) cv.wait_for(lock, timeout, [&] { return slot.done; });
+    pending.erase(seq);
+    if (!slot.done) return nullopt;
+    return slot.reply;
+}
+
+#ifdef __linux__
+namespace {
+atomic<bool> reuse_port{false};
+}
+
+bool enable_reuse_port() {
+    reuse_port = true;
+    return true;
+}
+
+// Wraps libc's bind() for the whole executable; see enable_reuse_port()
+extern "C" int bind(int sockfd, const struct sockaddr* addr, socklen_t len) noexcept {
+    using BindFn = int (*)(int, const struct sockaddr*, socklen_t);
+    static BindFn real_bind = (BindFn)dlsym(RTLD_NEXT, "bind");
+    if (reuse_port && addr && (addr->sa_family == AF_INET || addr->sa_family == AF_INET6)) {
+        int one = 1;
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof one);
+    }
+    return real_bind(sockfd, addr, len);
+}
+#else
+bool enable_reuse_port() {
+    return false;
+}
+#endif
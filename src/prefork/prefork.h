@@ -0,0 +1,92 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Prefork mode: a supervisor process forks N workers that each run the
+// whole server on the same port, restarts any that die, and relays
+// messages between them. Linux only, since it relies on SO_REUSEPORT to
+// spread connections over the workers and on PR_SET_PDEATHSIG to take
+// them down with the supervisor.
+//
+// Each worker is linked to the supervisor by a datagram socketpair, one
+// text message per datagram:
+//   worker -> supervisor  "b <msg>"        relay <msg> to every other worker
+//                         "c <seq> <req>"  request for the supervisor;
+//                                          seq 0 wants no reply
+//   supervisor -> worker  "m <msg>"        a relayed or supervisor message
+//                         "r <seq> <rep>"  reply to request <seq>
+// Relayed messages are best effort: a worker whose socket is full misses
+// them rather than stalling the others.
+class Supervisor {
+public:
+    struct Hooks {
+        // Answers a worker's WorkerChannel::call()
+        std::function<std::string(const std::string& request)> on_call;
+        // Called about every 250ms; each message returned goes to one
+        // worker, round-robin
+        std::function<std::vector<std::string>()> on_tick;
+    };
+
+    // Forks `workers` processes that each run `worker(index, fd)` and exit
+    // with its result; `fd` is the worker's end of its socketpair. Workers
+    // that die are restarted, with backoff if they die young. Returns once
+    // SIGINT or SIGTERM has been passed on and every worker has exited.
+    static int run(int workers, const std::function<int(int index, int fd)>& worker, const Hooks& hooks);
+};
+
+// A worker's end of the supervisor link. Thread-safe.
+class WorkerChannel {
+public:
+    using Handler = std::function<void(const std::string& message)>;
+
+    explicit WorkerChannel(int fd);
+    ~WorkerChannel();
+    WorkerChannel(const WorkerChannel&) = delete;
+    WorkerChannel& operator=(const WorkerChannel&) = delete;
+
+    // Starts the receiving thread; `on_message` runs on it, so it should
+    // hand anything slow to a pool
+    void start(Handler on_message);
+    void stop();
+
+    // Sends `message` to every other worker
+    void broadcast(const std::string& message);
+    // Asks the supervisor; nullopt if no answer came within `timeout`.
+    // Don't call from the message handler, which is what receives replies.
+    std::optional<std::string> call(const std::string& request,
+                                    std::chrono::milliseconds timeout = std::chrono::milliseconds(2000));
+    // Sends a request whose answer isn't needed
+    void tell(const std::string& request);
+
+private:
+    struct Pending {
+        bool done = false;
+        std::string reply;
+    };
+
+    int fd;
+    std::atomic<bool> running{false};
+    std::thread reader;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::map<uint64_t, Pending*> pending;
+    uint64_t next_seq = 1;
+
+    void readLoop(Handler on_message);
+    bool send(const std::string& datagram);
+};
+
+// Makes every TCP socket this process binds from now on set SO_REUSEPORT
+// first, so several processes can listen on one port. Crow opens its
+// listening socket internally and has no option for this, hence bind()
+// is wrapped for the whole process. Returns false where unsupported.
+bool enable_reuse_port();
@@ -0,0 +1,114 @@
+#include "spectator_hub.h"
+
+using namespace std;
+
+SpectatorHub::Snapshot SpectatorHub::store(Game& g, string body, uint64_t revision) {
+    g.revision = revision;
+    g.current.body = make_shared<const string>(std::move(body));
+    g.current.version = next_version++;
+    return g.current;
+}
+
+SpectatorHub::Snapshot SpectatorHub::lookup(int game_id) {
+    lock_guard<mutex> lock(mtx);
+    Game& g = games[game_id];
+    g.last_access = Clock::now();
+    return g.current;
+}
+
+bool SpectatorHub::watched(int game_id) {
+    lock_guard<mutex> lock(mtx);
+    return games.count(game_id) != 0;
+}
+
+void SpectatorHub::forget(int game_id) {
+    lock_guard<mutex> lock(mtx);
+    auto it = games.find(game_id);
+    if (it != games.end() && !it->second.current.body && it->second.waiters.empty()) games.erase(it);
+}
+
+SpectatorHub::Snapshot SpectatorHub::seed(int game_id, string body, uint64_t revision) {
+    return update(game_id, std::move(body), revision, false);
+}
+
+SpectatorHub::Snapshot SpectatorHub::publish(int game_id, string body, uint64_t revision) {
+    return update(game_id, std::move(body), revision, true);
+}
+
+SpectatorHub::Snapshot SpectatorHub::update(int game_id, string body, uint64_t revision, bool replace) {
+    vector<pair<uint64_t, Waiter>> woken;
+    Snapshot snap;
+    {
+        lock_guard<mutex> lock(mtx);
+        Game& g = games[game_id];
+        if (!replace) {
+            g.last_access = Clock::now();
+            if (g.current.body) return g.current;
+        }
+        if (g.current.body && revision <= g.revision) return g.current;
+        snap = store(g, std::move(body), revision);
+        woken.swap(g.waiters);
+        parked -= woken.size();
+    }
+    for (auto& w : woken) w.second(snap);
+    return snap;
+}
+
+uint64_t SpectatorHub::wait(int game_id, uint64_t since, Waiter w) {
+    Snapshot snap;
+    {
+        lock_guard<mutex> lock(mtx);
+        Game& g = games[game_id];
+        g.last_access = Clock::now();
+        if (!g.current.body || g.current.version <= since) {
+            uint64_t token = next_token++;
+            g.waiters.emplace_back(token, std::move(w));
+            parked++;
+            return token;
+        }
+        snap = g.current;
+    }
+    w(snap);
+    return 0;
+}
+
+void SpectatorHub::expire(int game_id, uint64_t token) {
+    Waiter w;
+    Snapshot snap;
+    {
+        lock_guard<mutex> lock(mtx);
+        auto it = games.find(game_id);
+        if (it == games.end()) return;
+        auto& waiters = it->second.waiters;
+        for (size_t i = 0; i < waiters.size(); i++) {
+            if (waiters[i].first != token) continue;
+            w = std::move(waiters[i].second);
+            waiters[i] = std::move(waiters.back());
+            waiters.pop_back();
+            parked--;
+            break;
+        }
+        snap = it->second.current;
+    }
+    if (w) w(snap);
+}
+
+size_t SpectatorHub::evictIdle(Clock::duration idle) {
+    lock_guard<mutex> lock(mtx);
+    auto cutoff = Clock::now() - idle;
+    size_t evicted = 0;
+    for (auto it = games.begin(); it != games.end();) {
+        if (it->second.waiters.empty() && it->second.last_access < cutoff) {
+            it = games.erase(it);
+            evicted++;
+        } else {
+            ++it;
+        }
+    }
+    return evicted;
+}
+
+size_t SpectatorHub::waiting() {
+    lock_guard<mutex> lock(mtx);
+    return parked;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Fan-out of game states to long-polling spectators.
+//
+// Each change to a watched game is serialized once into an immutable,
+// reference-counted Snapshot that every spectator is answered from, so a
+// game with thousands of watchers costs one DB read and one JSON build
+// per move. Versions come from a single counter across all games, so they
+// only ever increase, even if a game is evicted and loaded again.
+// Snapshots also carry the game's revision from the DB; one older than
+// the stored snapshot arrived late and is dropped.
+// Thread-safe; waiters run outside the lock.
+class SpectatorHub {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Snapshot {
+        std::shared_ptr<const std::string> body; // null if none yet
+        uint64_t version = 0;
+    };
+    using Waiter = std::function<void(const Snapshot&)>;
+
+    // The game's current snapshot. Also marks the game as watched, so
+    // changes are published from now on, even before the first snapshot
+    // has been loaded; call forget() if the game turns out not to exist.
+    Snapshot lookup(int game_id);
+    bool watched(int game_id);
+    // Drops a game that has no snapshot and no waiters
+    void forget(int game_id);
+
+    // Stores `body` unless a snapshot was published meanwhile, and returns
+    // whichever is current.
+    Snapshot seed(int game_id, std::string body, uint64_t revision);
+    // Replaces the game's snapshot, unless it is newer than `revision`,
+    // and wakes everyone waiting on it.
+    Snapshot publish(int game_id, std::string body, uint64_t revision);
+
+    // Parks `w` until the game's version passes `since`. Runs it right
+    // away and returns 0 if it already has; otherwise returns a token for
+    // expire().
+    uint64_t wait(int game_id, uint64_t since, Waiter w);
+    // Answers a waiter that is still parked with the current snapshot.
+    void expire(int game_id, uint64_t token);
+
+    // Forgets games nobody has looked at for `idle` and nobody waits on.
+    size_t evictIdle(Clock::duration idle);
+    size_t waiting();
+
+private:
+    struct Game {
+        Snapshot current;
+        uint64_t revision = 0;
+        Clock::time_point last_access;
+        std::vector<std::pair<uint64_t, Waiter>> waiters;
+    };
+
+    std::mutex mtx;
+    std::unordered_map<int, Game> games;
+    uint64_t next_version = 1;
+    uint64_t next_token = 1;
+    size_t parked = 0;
+
+    Snapshot store(Game& g, std::string body, uint64_t revision);
+    Snapshot update(int game_id, std::string body, uint64_t revision, bool replace);
+};
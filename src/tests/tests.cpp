@@ -0,0 +1,411 @@
+// Deterministic checks for the timing wheel, the matchmaking queue and
+// the position index.
+//
+// Prints each failed check with its line and exits non-zero if any
+// failed. The wheel is stepped by hand and the matchmaker is given its
+// clock readings, so nothing here depends on timing.
+//
+// Usage: ./tests [--dir PATH]   (scratch files go in PATH, default /tmp)
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "board/board.h"
+#include "board/board_json.h"
+#include "game_clock.h"
+#include "matchmaking.h"
+#include "position_index.h"
+#include "timing_wheel.h"
+
+using namespace std;
+
+static int checks = 0;
+static int failures = 0;
+
+#define CHECK(cond)                                                       \
+    do {                                                                  \
+        checks++;                                                         \
+        if (!(cond)) {                                                    \
+            failures++;                                                   \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);        \
+        }                                                                 \
+    } while (0)
+
+// ---- TimingWheel ----------------------------------------------------------
+
+// One tick per millisecond, so a delay in ms is a delay in ticks.
+static const chrono::milliseconds kTick(1);
+
+// Level boundaries are 2^8, 2^14 and 2^20 ticks; the wheel spans 2^26.
+static const uint64_t kDelays[] = {
+    0, 1, 2, 255, 256, 257, 1000, 16383, 16384, 16385, 100000,
+    (1u << 20) - 1, 1u << 20, (1u << 20) + 1, (1u << 20) + 777, 5000000, (1u << 26) - 1,
+};
+
+// A timer scheduled `delay` ticks after `offset` fires on exactly that
+// tick, from every level and from positions that aren't slot-aligned.
+static void test_wheel_fires_on_time() {
+    for (uint64_t offset : {0u, 200u, 70001u, (1u << 20) + 5u}) {
+        for (uint64_t delay : kDelays) {
+            TimingWheel wheel(kTick, false);
+            wheel.advance(offset);
+            int fired = 0;
+            wheel.schedule(chrono::milliseconds(delay), [&] { fired++; });
+            wheel.advance(delay);
+            if (fired != 0) printf("  early: offset %llu delay %llu\n", (unsigned long long)offset, (unsigned long long)delay);
+            CHECK(fired == 0);
+            wheel.advance(1);
+            if (fired != 1) printf("  missed: offset %llu delay %llu\n", (unsigned long long)offset, (unsigned long long)delay);
+            CHECK(fired == 1);
+            CHECK(wheel.pending() == 0);
+        }
+    }
+}
+
+// Delays past the wheel's span are clamped to its last tick.
+static void test_wheel_clamps_long_delays() {
+    TimingWheel wheel(kTick, false);
+    int fired = 0;
+    wheel.schedule(chrono::milliseconds((1LL << 26) + 5000), [&] { fired++; });
+    wheel.advance((1u << 26) - 1);
+    CHECK(fired == 0);
+    wheel.advance(1);
+    CHECK(fired == 1);
+}
+
+// Many timers at once, spread over the lower three levels, each fire on
+// their own tick and in no other.
+static void test_wheel_many_timers() {
+    TimingWheel wheel(kTick, false);
+    const uint64_t horizon = (1u << 21);
+    vector<uint64_t> due;
+    vector<uint64_t> fired_at;
+    uint64_t now = 0;
+    uint32_t x = 12345;
+    for (int i = 0; i < 2000; i++) {
+        x = x * 1103515245u + 12345u;
+        uint64_t delay = (x >> 8) % horizon;
+        due.push_back(delay);
+        fired_at.push_back(UINT64_MAX);
+        wheel.schedule(chrono::milliseconds(delay), [&, i] { fired_at[i] = now; });
+    }
+    for (now = 0; now <= horizon; now++) wheel.advance(1);
+    int wrong = 0;
+    for (size_t i = 0; i < due.size(); i++) wrong += fired_at[i] != due[i];
+    CHECK(wrong == 0);
+    CHECK(wheel.pending() == 0);
+}
+
+static void test_wheel_cancel() {
+    TimingWheel wheel(kTick, false);
+    int a = 0, b = 0;
+    auto id_a = wheel.schedule(chrono::milliseconds(300), [&] { a++; });
+    CHECK(wheel.pending() == 1);
+    CHECK(wheel.cancel(id_a));
+    CHECK(!wheel.cancel(id_a));
+    CHECK(wheel.pending() == 0);
+
+    // B reuses A's slot; A's stale id must not cancel it
+    auto id_b = wheel.schedule(chrono::milliseconds(300), [&] { b++; });
+    CHECK(id_b != id_a);
+    CHECK(!wheel.cancel(id_a));
+    wheel.advance(301);
+    CHECK(a == 0);
+    CHECK(b == 1);
+    CHECK(!wheel.cancel(id_b));
+    CHECK(!wheel.cancel(0));
+
+    // Cancelled from a higher level, before any cascade
+    auto id_c = wheel.schedule(chrono::milliseconds(1u << 21), [&] { a++; });
+    wheel.advance(1u << 20);
+    CHECK(wheel.cancel(id_c));
+    wheel.advance(1u << 21);
+    CHECK(a == 0);
+}
+
+// GameTimers re-arming replaces the pending deadline, and a disarmed game
+// never expires.
+static void test_game_timers_rearm() {
+    TimingWheel wheel(kTick, false);
+    vector<pair<int, uint64_t>> expired;
+    uint64_t now = 0;
+    GameTimers timers(wheel, [&](int game_id) { expired.push_back({game_id, now}); });
+
+    timers.arm(7, 100);
+    timers.arm(8, 150);
+    for (; now < 50; now++) wheel.advance(1);
+    timers.arm(7, 300); // due at 350 now
+    timers.disarm(8);
+    CHECK(timers.armed() == 1);
+    for (; now <= 1000; now++) wheel.advance(1);
+    CHECK(expired.size() == 1);
+    if (expired.size() == 1) {
+        CHECK(expired[0].first == 7);
+        CHECK(expired[0].second == 350);
+    }
+    CHECK(timers.armed() == 0);
+    CHECK(wheel.pending() == 0);
+}
+
+// ---- Matchmaker -----------------------------------------------------------
+
+static void test_matchmaker_pairs_within_base_window() {
+    Matchmaker mm(50, 10, 500);
+    auto t0 = Matchmaker::Clock::now();
+    CHECK(!mm.join("ann", 1500, t0));
+    CHECK(!mm.join("bob", 1600, t0)); // 100 apart
+    CHECK(!mm.join("ann", 1500, t0)); // already queued: no-op
+    CHECK(mm.waitingCount() == 2);
+
+    // 40 from ann, 60 from bob: pairs with ann, who waited longer
+    auto pair = mm.join("cat", 1540, t0 + chrono::seconds(1));
+    CHECK(pair.has_value());
+    if (pair) {
+        CHECK(pair->player1 == "ann");
+        CHECK(pair->player2 == "cat");
+    }
+    CHECK(mm.waitingCount() == 1);
+    CHECK(mm.status("ann", t0).state == Matchmaker::Status::Idle);
+}
+
+static void test_matchmaker_window_widens() {
+    Matchmaker mm(50, 10, 500);
+    auto t0 = Matchmaker::Clock::now();
+    mm.join("bob", 1600, t0);
+    auto s = mm.status("bob", t0 + chrono::seconds(3));
+    CHECK(s.state == Matchmaker::Status::Waiting);
+    CHECK(s.window == 80);
+    CHECK(s.waited_s == 3.0);
+    CHECK(mm.status("bob", t0 + chrono::seconds(100)).window == 500);
+    CHECK(mm.status("bob", t0 + chrono::milliseconds(1500)).window == 65);
+
+    // 100 apart: joining doesn't pair them, the sweep does once bob's
+    // window has grown to 100
+    CHECK(!mm.join("dan", 1700, t0 + chrono::seconds(2)));
+    CHECK(mm.sweep(t0 + chrono::milliseconds(4900)).empty());
+    auto pairs = mm.sweep(t0 + chrono::seconds(5));
+    CHECK(pairs.size() == 1);
+    if (pairs.size() == 1) {
+        CHECK(pairs[0].player1 == "bob");
+        CHECK(pairs[0].player2 == "dan");
+    }
+    CHECK(mm.waitingCount() == 0);
+}
+
+static void test_matchmaker_sweep_picks_closest() {
+    Matchmaker mm(0, 100, 1000);
+    auto t0 = Matchmaker::Clock::now();
+    mm.join("a", 1000, t0);
+    mm.join("b", 1250, t0 + chrono::seconds(1));
+    mm.join("c", 1120, t0 + chrono::seconds(2));
+    mm.join("d", 2000, t0 + chrono::seconds(3));
+    // At 3s a's window is 300: c (120) beats b (250); b's window of 200
+    // can't reach d (750)
+    auto pairs = mm.sweep(t0 + chrono::seconds(3));
+    CHECK(pairs.size() == 1);
+    if (pairs.size() == 1) {
+        CHECK(pairs[0].player1 == "a");
+        CHECK(pairs[0].player2 == "c");
+    }
+    CHECK(mm.waitingCount() == 2);
+}
+
+static void test_matchmaker_leave_requeue_and_match() {
+    Matchmaker mm(50, 10, 500);
+    auto t0 = Matchmaker::Clock::now();
+    mm.join("eve", 1200, t0);
+    CHECK(mm.leave("eve"));
+    CHECK(!mm.leave("eve"));
+    CHECK(mm.waitingCount() == 0);
+
+    // Requeued players keep their original wait
+    mm.requeue("eve", 1200, t0);
+    mm.requeue("eve", 1200, t0 + chrono::seconds(5)); // already queued
+    auto s = mm.status("eve", t0 + chrono::seconds(2));
+    CHECK(s.state == Matchmaker::Status::Waiting);
+    CHECK(s.waited_s == 2.0);
+    CHECK(s.window == 70);
+
+    mm.recordMatch(MatchPair{"fay", "gus"}, 42);
+    auto m = mm.status("fay", t0);
+    CHECK(m.state == Matchmaker::Status::Matched);
+    CHECK(m.game_id == 42);
+    CHECK(mm.status("fay", t0).state == Matchmaker::Status::Idle); // reported once
+    CHECK(mm.status("gus", t0).game_id == 42);
+}
+
+// ---- PositionIndex --------------------------------------------------------
+
+static string scratch_dir = "/tmp";
+
+static string scratch_path(const char* name) {
+    string path = scratch_dir + "/" + name + "-" + to_string(getpid()) + ".idx";
+    std::error_code ec;
+    filesystem::remove(path, ec);
+    filesystem::remove(path + ".lock", ec);
+    return path;
+}
+
+// Keys that start probing at the same slot of the initial 2^16 table
+static void test_index_probe() {
+    string path = scratch_path("probe");
+    PositionIndex index;
+    bool created = false;
+    CHECK(index.open(path, created));
+    CHECK(created);
+    CHECK(index.positions() == 0);
+
+    const uint64_t base = 0x1234;
+    for (uint64_t i = 0; i < 5; i++) {
+        for (uint64_t n = 0; n <= i; n++) index.recordMove(base + (i << 16), 8, (int)(10 + i));
+    }
+    CHECK(index.positions() == 5);
+    for (uint64_t i = 0; i < 5; i++) {
+        auto st = index.lookup(base + (i << 16));
+        CHECK(st.found);
+        CHECK(st.size == 8);
+        CHECK(st.moves.size() == 1);
+        if (st.moves.size() == 1) {
+            CHECK(st.moves[0].square == (int)(10 + i));
+            CHECK(st.moves[0].count == i + 1);
+        }
+    }
+    // Same start slot, never inserted: the probe runs past the others
+    CHECK(!index.lookup(base + (9ull << 16)).found);
+    CHECK(!index.lookup(base + 1).found);
+
+    // A takeback uncounts the move and never inserts
+    index.recordMove(base, 8, 10, -1);
+    CHECK(index.lookup(base).moves.empty());
+    index.recordMove(base + 7, 8, 10, -1);
+    CHECK(!index.lookup(base + 7).found);
+    CHECK(index.positions() == 5);
+
+    filesystem::remove(path);
+}
+
+// Filling past 70% doubles the table into a new file; every entry must
+// survive the rehash and a reopen.
+static void test_index_grow_and_reopen() {
+    string path = scratch_path("grow");
+    const uint64_t n = 100000; // past 0.7 * 2^16 and 0.7 * 2^17
+    auto key = [](uint64_t i) { return (i + 1) * 0x9e3779b97f4a7c15ull; };
+    uintmax_t initial_size = 0;
+    {
+        PositionIndex index;
+        bool created = false;
+        CHECK(index.open(path, created));
+        initial_size = filesystem::file_size(path);
+        for (uint64_t i = 0; i < n; i++) index.recordMove(key(i), 8, (int)(i % 60));
+        CHECK(index.positions() == n);
+        CHECK(filesystem::file_size(path) >= 4 * initial_size - 4096);
+        CHECK(!filesystem::exists(path + ".tmp"));
+    }
+    {
+        PositionIndex index;
+        bool created = true;
+        CHECK(index.open(path, created));
+        CHECK(!created);
+        CHECK(index.positions() == n);
+        uint64_t missing = 0;
+        for (uint64_t i = 0; i < n; i++) {
+            auto st = index.lookup(key(i));
+            if (!st.found || st.moves.size() != 1 || st.moves[0].square != (int)(i % 60) || st.moves[0].count != 1) missing++;
+        }
+        CHECK(missing == 0);
+        CHECK(!index.lookup(key(n)).found);
+    }
+    // Anything that isn't an index is refused
+    {
+        FILE* f = fopen(path.c_str(), "wb");
+        fputs("not an index", f);
+        fclose(f);
+        PositionIndex index;
+        bool created = false;
+        CHECK(!index.open(path, created));
+    }
+    filesystem::remove(path);
+}
+
+// Results are credited along the game's path, which hashes the same way
+// incrementally as from the boards it passes through.
+static void test_index_results() {
+    string path = scratch_path("results");
+    PositionIndex index;
+    bool created = false;
+    CHECK(index.open(path, created));
+
+    Board board;
+    auto start = board.getBoard();
+    int row = -1, col = -1;
+    for (int r = 0; r < 8 && row < 0; r++) {
+        for (int c = 0; c < 8; c++) {
+            if (start[r][c] == 0 && board.flipVectors(r, c, 1, false)) {
+                row = r;
+                col = c;
+                break;
+            }
+        }
+    }
+    CHECK(row >= 0);
+    if (row < 0) return;
+    auto flips = board.addPiece(row, col, 1);
+    vector<LoggedMove> log = {{row * 8 + col, (FlipMask)flips}, {-1, 0}};
+
+    uint64_t h0 = PositionIndex::hashBoard(start, 1);
+    uint64_t h1 = PositionIndex::hashBoard(board.getBoard(), -1);
+    uint64_t h2 = PositionIndex::hashBoard(board.getBoard(), 1);
+    CHECK(h0 == PositionIndex::hashBoard(initial_board(8), 1));
+    CHECK(PositionIndex::applyMove(h0, row * 8 + col, flips, 1) == h1);
+    CHECK(PositionIndex::applyMove(h1, PositionIndex::kPass, 0, -1) == h2);
+
+    index.recordMoves(8, log);
+    index.recordResult(8, log, -1);
+    index.recordResult(8, log, 0);
+    auto s0 = index.lookup(h0);
+    CHECK(s0.found && s0.o_wins == 1 && s0.draws == 1 && s0.x_wins == 0);
+    CHECK(s0.moves.size() == 1 && s0.moves[0].square == row * 8 + col);
+    auto s1 = index.lookup(h1);
+    CHECK(s1.found && s1.moves.size() == 1 && s1.moves[0].square == PositionIndex::kPass);
+    auto s2 = index.lookup(h2);
+    CHECK(s2.found && s2.o_wins == 1 && s2.draws == 1 && s2.moves.empty());
+    CHECK(index.positions() == 3);
+
+    filesystem::remove(path);
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        string a = argv[i];
+        if (a == "--dir" && i + 1 < argc) {
+            scratch_dir = argv[++i];
+        } else {
+            fprintf(stderr, "unknown option %s\n", a.c_str());
+            return 2;
+        }
+    }
+
+    test_wheel_fires_on_time();
+    test_wheel_clamps_long_delays();
+    test_wheel_many_timers();
+    test_wheel_cancel();
+    test_game_timers_rearm();
+
+    test_matchmaker_pairs_within_base_window();
+    test_matchmaker_window_widens();
+    test_matchmaker_sweep_picks_closest();
+    test_matchmaker_leave_requeue_and_match();
+
+    test_index_probe();
+    test_index_grow_and_reopen();
+    test_index_results();
+
+    printf("%d checks, %d failed\n", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,96 @@
+#include "text_analyzer.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define TEXT_ANALYZER_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+struct VowelTable {
+    unsigned char v[256] = {};
+    constexpr VowelTable() {
+        const char* vowels = "aeiouAEIOU";
+        for (int i = 0; vowels[i]; i++) v[(unsigned char)vowels[i]] = 1;
+    }
+};
+
+constexpr VowelTable kVowels;
+
+int countScalar(const unsigned char* p, size_t len) {
+    int n = 0;
+    for (size_t i = 0; i < len; i++) n += kVowels.v[p[i]];
+    return n;
+}
+
+#ifdef TEXT_ANALYZER_X86
+
+// Setting bit 0x20 folds 'A'..'Z' onto 'a'..'z'. The only byte other than
+// 'a' that folds onto 'a' is 'A' (same for e/i/o/u), so one compare per
+// vowel is exact.
+size_t countSse2(const unsigned char* p, size_t len, int& n) {
+    const __m128i fold = _mm_set1_epi8(0x20);
+    const __m128i a = _mm_set1_epi8('a');
+    const __m128i e = _mm_set1_epi8('e');
+    const __m128i i_ = _mm_set1_epi8('i');
+    const __m128i o = _mm_set1_epi8('o');
+    const __m128i u = _mm_set1_epi8('u');
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i x = _mm_or_si128(_mm_loadu_si128((const __m128i*)(p + i)), fold);
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(x, a), _mm_cmpeq_epi8(x, e)),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, i_), _mm_cmpeq_epi8(x, o)),
+                         _mm_cmpeq_epi8(x, u)));
+        n += __builtin_popcount((unsigned)_mm_movemask_epi8(m));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t countAvx2(const unsigned char* p, size_t len, int& n) {
+    const __m256i fold = _mm256_set1_epi8(0x20);
+    const __m256i a = _mm256_set1_epi8('a');
+    const __m256i e = _mm256_set1_epi8('e');
+    const __m256i i_ = _mm256_set1_epi8('i');
+    const __m256i o = _mm256_set1_epi8('o');
+    const __m256i u = _mm256_set1_epi8('u');
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(p + i)), fold);
+        __m256i m = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(x, a), _mm256_cmpeq_epi8(x, e)),
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, i_), _mm256_cmpeq_epi8(x, o)),
+                            _mm256_cmpeq_epi8(x, u)));
+        n += __builtin_popcount((unsigned)_mm256_movemask_epi8(m));
+    }
+    return i;
+}
+
+bool hasAvx2() {
+    static const bool yes = __builtin_cpu_supports("avx2");
+    return yes;
+}
+
+#endif
+
+}
+
+int TextAnalyzer::countVowels(const string& text) {
+    return countVowels(text.data(), text.size());
+}
+
+int TextAnalyzer::countVowels(const char* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    int n = 0;
+    size_t done = 0;
+#ifdef TEXT_ANALYZER_X86
+    if (hasAvx2()) done = countAvx2(p, len, n);
+    done += countSse2(p + done, len - done, n);
+#endif
+    return n + countScalar(p + done, len - done);
+}
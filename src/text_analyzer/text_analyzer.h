@@ -0,0 +1,11 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+class TextAnalyzer {
+public:
+    // Counts ASCII vowels (a, e, i, o, u, either case).
+    // Uses AVX2 or SSE2 when the CPU has them, scalar code otherwise.
+    static int countVowels(const std::string& text);
+    static int countVowels(const char* data, size_t len);
+};
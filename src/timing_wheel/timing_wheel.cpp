@@ -0,0 +1,174 @@
+#include "timing_wheel.h"
+
+using namespace std;
+
+namespace {
+const int kBits[] = {8, 6, 6, 6};
+const int kShift[] = {0, 8, 14, 20};
+const uint64_t kSpan = 1ULL << 26;
+
+inline uint32_t slotOf(uint64_t tick, int level) {
+    return (uint32_t)((tick >> kShift[level]) & ((1u << kBits[level]) - 1));
+}
+}
+
+TimingWheel::TimingWheel(chrono::milliseconds tick, bool driven)
+    : tick(tick.count() > 0 ? tick : chrono::milliseconds(1)), driven(driven), start(Clock::now()) {
+    for (int l = 0; l < kLevels; l++) slots[l].assign(1u << kBits[l], kNil);
+    if (driven) driver = thread([this] { run(); });
+}
+
+TimingWheel::~TimingWheel() {
+    stop();
+}
+
+void TimingWheel::stop() {
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (driver.joinable() && driver.get_id() != this_thread::get_id()) driver.join();
+}
+
+void TimingWheel::link(uint32_t idx) {
+    Node& n = nodes[idx];
+    uint64_t delta = n.expires > current ? n.expires - current : 0;
+    int level = 0;
+    if (delta >= kSpan) {
+        n.expires = current + kSpan - 1;
+        delta = kSpan - 1;
+    }
+    while (level < kLevels - 1 && delta >= (1ULL << (kShift[level + 1]))) level++;
+    uint32_t slot = slotOf(delta == 0 ? current : n.expires, level);
+
+    n.level = (int16_t)level;
+    n.slot = (uint16_t)slot;
+    n.prev = kNil;
+    n.next = slots[level][slot];
+    if (n.next != kNil) nodes[n.next].prev = idx;
+    slots[level][slot] = idx;
+}
+
+void TimingWheel::unlink(uint32_t idx) {
+    Node& n = nodes[idx];
+    if (n.prev != kNil) nodes[n.prev].next = n.next;
+    else slots[n.level][n.slot] = n.next;
+    if (n.next != kNil) nodes[n.next].prev = n.prev;
+    n.prev = n.next = kNil;
+    n.level = -1;
+}
+
+void TimingWheel::release(uint32_t idx) {
+    nodes[idx].cb = nullptr;
+    nodes[idx].gen++;
+    free_list.push_back(idx);
+    count--;
+}
+
+TimingWheel::TimerId TimingWheel::schedule(chrono::milliseconds delay, Callback cb) {
+    lock_guard<mutex> lock(mtx);
+    uint32_t idx;
+    if (!free_list.empty()) {
+        idx = free_list.back();
+        free_list.pop_back();
+    } else {
+        idx = (uint32_t)nodes.size();
+        nodes.emplace_back();
+    }
+
+    // Round up so a timer never fires early.
+    long long ticks = delay.count() <= 0 ? 0 : (delay.count() + tick.count() - 1) / tick.count();
+    uint64_t now_tick = driven ? (uint64_t)(chrono::duration_cast<chrono::milliseconds>(Clock::now() - start).count() / tick.count()) : current;
+    Node& n = nodes[idx];
+    n.expires = (now_tick > current ? now_tick : current) + (uint64_t)ticks;
+    n.cb = std::move(cb);
+    link(idx);
+    count++;
+    return ((uint64_t)n.gen << 32) | (idx + 1);
+}
+
+bool TimingWheel::cancel(TimerId id) {
+    if (id == 0) return false;
+    lock_guard<mutex> lock(mtx);
+    uint32_t idx = (uint32_t)(id & 0xFFFFFFFFu) - 1;
+    if (idx >= nodes.size()) return false;
+    Node& n = nodes[idx];
+    if (n.gen != (uint32_t)(id >> 32) || n.level < 0) return false;
+    unlink(idx);
+    release(idx);
+    return true;
+}
+
+size_t TimingWheel::pending() {
+    lock_guard<mutex> lock(mtx);
+    return count;
+}
+
+void TimingWheel::cascade(int level, uint32_t slot) {
+    uint32_t idx = slots[level][slot];
+    slots[level][slot] = kNil;
+    while (idx != kNil) {
+        uint32_t next = nodes[idx].next;
+        link(idx);
+        idx = next;
+    }
+}
+
+void TimingWheel::step(vector<Callback>& due) {
+    uint32_t slot0 = slotOf(current, 0);
+    if (slot0 == 0) {
+        for (int level = 1; level < kLevels; level++) {
+            uint32_t s = slotOf(current, level);
+            cascade(level, s);
+            if (s != 0) break;
+        }
+    }
+
+    uint32_t idx = slots[0][slot0];
+    slots[0][slot0] = kNil;
+    while (idx != kNil) {
+        uint32_t next = nodes[idx].next;
+        nodes[idx].level = -1;
+        due.push_back(std::move(nodes[idx].cb));
+        release(idx);
+        idx = next;
+    }
+    current++;
+}
+
+size_t TimingWheel::advance(uint64_t ticks) {
+    size_t fired = 0;
+    vector<Callback> due;
+    unique_lock<mutex> lock(mtx);
+    for (uint64_t i = 0; i < ticks; i++) {
+        step(due);
+        if (due.empty()) continue;
+        lock.unlock();
+        for (auto& cb : due) cb();
+        fired += due.size();
+        due.clear();
+        lock.lock();
+    }
+    return fired;
+}
+
+void TimingWheel::run() {
+    vector<Callback> due;
+    unique_lock<mutex> lock(mtx);
+    while (!stopping) {
+        auto next_at = start + tick * (long long)(current + 1);
+        cv.wait_until(lock, next_at, [this] { return stopping; });
+        if (stopping) break;
+
+        uint64_t now_tick = (uint64_t)(chrono::duration_cast<chrono::milliseconds>(Clock::now() - start).count() / tick.count());
+        while (current <= now_tick) step(due);
+
+        if (!due.empty()) {
+            lock.unlock();
+            for (auto& cb : due) cb();
+            due.clear();
+            lock.lock();
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Hierarchical timing wheel (Varghese & Lauck, as in the Linux kernel).
+//
+// Four levels of 256/64/64/64 slots cover 2^26 ticks (about 7.7 days at
+// the default 10ms tick); longer delays are clamped to that. Timers live
+// in a pooled array linked into per-slot lists, so schedule and cancel are
+// O(1), and each tick fires one slot, occasionally cascading a slot from
+// a higher level down. A background thread drives the wheel; callbacks
+// run on it and must not block (hand blocking work to an Executor).
+class TimingWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void()>;
+    using TimerId = uint64_t; // 0 is never a valid id
+
+    // With `driven` false there is no driver thread and no clock: time
+    // only moves through advance(), so tests can check exact ticks.
+    explicit TimingWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(10), bool driven = true);
+    ~TimingWheel();
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    TimerId schedule(std::chrono::milliseconds delay, Callback cb);
+    // Returns false if the timer already fired or was cancelled
+    bool cancel(TimerId id);
+    size_t pending();
+    // Stops the driver thread; timers still pending never fire. Idempotent.
+    void stop();
+    // Processes the next `ticks` ticks on the calling thread, running each
+    // tick's callbacks before the next tick; returns how many ran. Only for
+    // wheels made with `driven` false.
+    size_t advance(uint64_t ticks);
+
+private:
+    static constexpr int kLevels = 4;
+    static constexpr uint32_t kNil = 0xFFFFFFFFu;
+
+    struct Node {
+        uint64_t expires = 0;
+        uint32_t prev = kNil;
+        uint32_t next = kNil;
+        uint32_t gen = 0;
+        int16_t level = -1; // -1 = not scheduled
+        uint16_t slot = 0;
+        Callback cb;
+    };
+
+    std::chrono::milliseconds tick;
+    bool driven;
+    Clock::time_point start;
+    uint64_t current = 0; // next tick to process
+    std::vector<Node> nodes;
+    std::vector<uint32_t> free_list;
+    std::vector<uint32_t> slots[kLevels];
+    size_t count = 0;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping = false;
+    std::thread driver;
+
+    void link(uint32_t idx);
+    void unlink(uint32_t idx);
+    void release(uint32_t idx);
+    void cascade(int level, uint32_t slot);
+    // Processes one tick; appends due callbacks to `due`
+    void step(std::vector<Callback>& due);
+    void run();
+};
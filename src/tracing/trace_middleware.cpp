@@ -0,0 +1,23 @@
+#include "trace_middleware.h"
+#include "tracing.h"
+
+bool TraceMiddleware::trusted(const crow::request& req) const {
+    if (!trust_loopback) return false;
+    const std::string& ip = req.remote_ip_address;
+    return ip.rfind("127.", 0) == 0 || ip == "::1" || ip.rfind("::ffff:127.", 0) == 0;
+}
+
+void TraceMiddleware::before_handle(crow::request& req, crow::response&, context& ctx) {
+    // Anyone else asking would get around the sample rate
+    bool forced = req.get_header_value("X-Trace") == "1" && trusted(req);
+    ctx.trace_id = Tracer::beginRequest(forced);
+    if (ctx.trace_id) ctx.start = Tracer::nowNanos();
+}
+
+void TraceMiddleware::after_handle(crow::request& req, crow::response&, context& ctx) {
+    if (ctx.trace_id) {
+        Tracer::setCurrent(ctx.trace_id);
+        Tracer::record("request", ctx.start, Tracer::nowNanos() - ctx.start, req.url.c_str());
+    }
+    Tracer::endRequest();
+}
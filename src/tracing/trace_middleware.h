@@ -0,0 +1,22 @@
+#pragma once
+#include <crow.h>
+#include <cstdint>
+
+// Starts a trace for sampled requests and records the whole request as
+// its outermost span.
+struct TraceMiddleware {
+    // Lets trusted() accept clients on a loopback address. Off by default.
+    bool trust_loopback = false;
+
+    // Whether `req` may force a trace with "X-Trace: 1" and read internal
+    // state without logging in.
+    bool trusted(const crow::request& req) const;
+
+    struct context {
+        uint64_t trace_id = 0;
+        uint64_t start = 0;
+    };
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+};
@@ -0,0 +1,154 @@
+#include "tracing.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const size_t kRingSize = 4096;
+const size_t kDetailLen = 48;
+
+struct Event {
+    const char* name;
+    uint64_t trace_id;
+    uint64_t start_ns;
+    uint64_t dur_ns;
+    char detail[kDetailLen];
+};
+
+// Owner thread appends; the dumper reads under the same mutex, which is
+// otherwise uncontended.
+struct Ring {
+    mutex mtx;
+    int tid;
+    size_t next = 0;
+    size_t size = 0;
+    Event events[kRingSize];
+};
+
+mutex rings_mtx;
+vector<Ring*> rings; // never freed, so a dump still sees finished threads
+atomic<int> next_tid{1};
+atomic<uint64_t> next_trace{1};
+atomic<uint32_t> sample_threshold{0}; // out of 2^32 - 1
+
+thread_local uint64_t current_trace = 0;
+
+const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+
+Ring& localRing() {
+    thread_local Ring* ring = nullptr;
+    if (!ring) {
+        ring = new Ring();
+        ring->tid = next_tid.fetch_add(1);
+        lock_guard<mutex> lock(rings_mtx);
+        rings.push_back(ring);
+    }
+    return *ring;
+}
+
+bool sampled() {
+    uint32_t threshold = sample_threshold.load(memory_order_relaxed);
+    if (threshold == 0) return false;
+    thread_local mt19937 rng(random_device{}());
+    return rng() <= threshold;
+}
+
+void writeJsonString(ostringstream& out, const char* s) {
+    out << '"';
+    for (; *s; s++) {
+        char c = *s;
+        if (c == '"' || c == '\\') out << '\\' << c;
+        else if ((unsigned char)c < 0x20) out << ' ';
+        else out << c;
+    }
+    out << '"';
+}
+
+}
+
+void Tracer::setSampleRate(double rate) {
+    if (rate <= 0) sample_threshold.store(0);
+    else if (rate >= 1) sample_threshold.store(0xFFFFFFFFu);
+    else sample_threshold.store((uint32_t)(rate * 4294967295.0));
+}
+
+uint64_t Tracer::beginRequest(bool force) {
+    current_trace = (force || sampled()) ? next_trace.fetch_add(1, memory_order_relaxed) : 0;
+    return current_trace;
+}
+
+void Tracer::endRequest() {
+    current_trace = 0;
+}
+
+uint64_t Tracer::current() {
+    return current_trace;
+}
+
+void Tracer::setCurrent(uint64_t trace_id) {
+    current_trace = trace_id;
+}
+
+uint64_t Tracer::nowNanos() {
+    // +1 so a valid start time is never 0
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count() + 1;
+}
+
+void Tracer::record(const char* name, uint64_t start_ns, uint64_t dur_ns, const char* detail) {
+    if (!current_trace) return;
+    Ring& ring = localRing();
+    lock_guard<mutex> lock(ring.mtx);
+    Event& e = ring.events[ring.next];
+    e.name = name;
+    e.trace_id = current_trace;
+    e.start_ns = start_ns;
+    e.dur_ns = dur_ns;
+    e.detail[0] = '\0';
+    if (detail) {
+        strncpy(e.detail, detail, kDetailLen - 1);
+        e.detail[kDetailLen - 1] = '\0';
+    }
+    ring.next = (ring.next + 1) % kRingSize;
+    if (ring.size < kRingSize) ring.size++;
+}
+
+string Tracer::dumpChromeJson() {
+    vector<Ring*> snapshot;
+    {
+        lock_guard<mutex> lock(rings_mtx);
+        snapshot = rings;
+    }
+
+    ostringstream out;
+    out << fixed << setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (Ring* ring : snapshot) {
+        lock_guard<mutex> lock(ring->mtx);
+        size_t start = (ring->next + kRingSize - ring->size) % kRingSize;
+        for (size_t i = 0; i < ring->size; i++) {
+            const Event& e = ring->events[(start + i) % kRingSize];
+            if (!first) out << ",";
+            first = false;
+            out << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->tid << ",\"name\":";
+            writeJsonString(out, e.name);
+            out << ",\"ts\":" << e.start_ns / 1000.0 << ",\"dur\":" << e.dur_ns / 1000.0;
+            out << ",\"args\":{\"trace_id\":" << e.trace_id;
+            if (e.detail[0]) {
+                out << ",\"detail\":";
+                writeJsonString(out, e.detail);
+            }
+            out << "}}";
+        }
+    }
+    out << "]}";
+    return out.str();
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+// Sampled request tracing.
+//
+// A request is picked for tracing when it starts (at the configured sample
+// rate, or always when a trusted client sends "X-Trace: 1"; see
+// TraceMiddleware::trusted). Spans opened on that
+// thread while the request is current are recorded into a per-thread ring
+// buffer; on unsampled requests a span costs one thread-local read.
+// dumpChromeJson() renders every buffer as Chrome trace_event JSON, which
+// Perfetto and chrome://tracing can open.
+class Tracer {
+public:
+    static void setSampleRate(double rate);
+
+    // Marks the calling thread as working on a new request and decides
+    // whether it is sampled. Returns the trace id, 0 when not sampled.
+    static uint64_t beginRequest(bool force);
+    static void endRequest();
+
+    // Current request's trace id on this thread (0 = not sampled), and a
+    // way to adopt one on another thread.
+    static uint64_t current();
+    static void setCurrent(uint64_t trace_id);
+
+    static uint64_t nowNanos();
+
+    // Records a finished span. `name` must outlive the process (a string
+    // literal); `detail` is copied and truncated.
+    static void record(const char* name, uint64_t start_ns, uint64_t dur_ns, const char* detail = nullptr);
+
+    static std::string dumpChromeJson();
+};
+
+class TraceSpan {
+private:
+    const char* name;
+    uint64_t start;
+public:
+    explicit TraceSpan(const char* name) : name(name), start(Tracer::current() ? Tracer::nowNanos() : 0) {}
+    ~TraceSpan() {
+        if (start) Tracer::record(name, start, Tracer::nowNanos() - start);
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+};